@@ -0,0 +1,301 @@
+// Measures the JSON utilities on a corpus of RPC envelopes like those that
+// bindings send. Every benchmark runs over every corpus and prints one line
+// with its throughput and per-call latency percentiles, so that the output
+// of two commits can be compared line by line.
+//
+// Usage: json_bench [--min-time SECONDS] [FILTER]
+// FILTER only runs the benchmarks whose "benchmark/corpus" name contains it.
+
+#include "json_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace webview::json;
+using bench_clock = std::chrono::steady_clock;
+
+struct corpus {
+  const char *name;
+  std::vector<std::string> messages;
+  // Every string in the messages as it appears in JSON, quotes included
+  std::vector<std::string> raw_strings;
+  // The same strings unescaped
+  std::vector<std::string> strings;
+};
+
+struct benchmark {
+  const char *name;
+  // Returns the items of the corpus that a single call works on
+  const std::vector<std::string> &(*items)(const corpus &c);
+  std::function<size_t(const std::string &item)> run;
+};
+
+struct result {
+  double megabytes_per_second;
+  double p50, p90, p99;
+  size_t calls;
+};
+
+// Something for the results to be written to so that calls aren't optimized
+// away.
+volatile size_t sink;
+
+const char *const method_names[] = {"increment", "compute", "openFile",
+                                    "getSettings", "log"};
+
+// Multi-byte characters of every length, plus escapes for the decoder
+const char *const utf8_pieces[] = {"é",  "ß",      "フー", "中文", "😀",
+                                   "𝄞", "\\u00e9", "\\n",  "\\ud83d\\ude00"};
+
+std::string random_ascii(std::mt19937 &rng, size_t n) {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-./";
+  std::string s;
+  s.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    s += alphabet[rng() % (sizeof(alphabet) - 1)];
+  }
+  return s;
+}
+
+// Returns the body of a JSON string, i.e. what goes between the quotes
+std::string random_escaped(std::mt19937 &rng, size_t n) {
+  static const char *const escapes[] = {"\\n", "\\\"", "\\\\", "\\t",
+                                        "\\u0001"};
+  std::string s;
+  s.reserve(n + n / 32);
+  while (s.size() < n) {
+    s += random_ascii(rng, 16 + rng() % 96);
+    s += escapes[rng() % 5];
+  }
+  return s;
+}
+
+std::string random_utf8(std::mt19937 &rng, size_t n) {
+  std::string s;
+  s.reserve(n + 16);
+  while (s.size() < n) {
+    s += utf8_pieces[rng() % (sizeof(utf8_pieces) / sizeof(*utf8_pieces))];
+    if (rng() % 4 == 0) {
+      s += random_ascii(rng, 1 + rng() % 8);
+    }
+  }
+  return s;
+}
+
+std::string random_arg(std::mt19937 &rng) {
+  switch (rng() % 5) {
+  case 0:
+    return std::to_string(rng() % 100000);
+  case 1:
+    return std::to_string(static_cast<double>(rng()) / 1000.0);
+  case 2:
+    return rng() % 2 ? "true" : "false";
+  case 3:
+    return "null";
+  default:
+    return "\"" + random_ascii(rng, 4 + rng() % 16) + "\"";
+  }
+}
+
+std::string envelope(size_t id, std::mt19937 &rng, const std::string &params) {
+  return "{\"id\":\"" + std::to_string(id) + "\",\"method\":\"" +
+         method_names[rng() % 5] + "\",\"params\":" + params + "}";
+}
+
+std::string nested(std::mt19937 &rng, int depth) {
+  if (depth == 0) {
+    return random_arg(rng);
+  }
+  return "{\"key\":" + random_arg(rng) + ",\"children\":[" +
+         nested(rng, depth - 1) + "," + random_arg(rng) +
+         "],\"value\":" + random_arg(rng) + "}";
+}
+
+// Builds the corpus that a given generator produces and collects its strings
+corpus make_corpus(const char *name, size_t count,
+                   std::function<std::string(std::mt19937 &)> params) {
+  corpus c{name, {}, {}, {}};
+  std::mt19937 rng(1);
+  tape t;
+  for (size_t i = 0; i < count; i++) {
+    c.messages.push_back(envelope(i, rng, params(rng)));
+    if (!t.parse(c.messages.back())) {
+      fprintf(stderr, "%s: generated invalid JSON\n", name);
+      exit(1);
+    }
+    for (size_t j = 0; j < t.size(); j++) {
+      if (t[j].type == token_type::string) {
+        c.raw_strings.emplace_back(t.text(j));
+        c.strings.push_back(t.str(j));
+      }
+    }
+  }
+  return c;
+}
+
+std::vector<corpus> make_corpora() {
+  std::vector<corpus> corpora;
+  corpora.push_back(make_corpus("small_calls", 4096, [](std::mt19937 &rng) {
+    std::string params = "[";
+    for (size_t n = rng() % 4, i = 0; i < n; i++) {
+      params += (i ? "," : "") + random_arg(rng);
+    }
+    return params + "]";
+  }));
+  corpora.push_back(make_corpus("wide_args", 128, [](std::mt19937 &rng) {
+    std::string params = "[";
+    for (int i = 0; i < 512; i++) {
+      params += (i ? "," : "") + random_arg(rng);
+    }
+    return params + "]";
+  }));
+  corpora.push_back(make_corpus("big_strings", 16, [](std::mt19937 &rng) {
+    return "[\"" + random_escaped(rng, 256 * 1024) + "\"]";
+  }));
+  corpora.push_back(make_corpus("deep_nesting", 128, [](std::mt19937 &rng) {
+    return "[" + nested(rng, 48) + "]";
+  }));
+  corpora.push_back(make_corpus("utf8_heavy", 128, [](std::mt19937 &rng) {
+    std::string params = "[";
+    for (int i = 0; i < 8; i++) {
+      params += std::string(i ? "," : "") + "\"" + random_utf8(rng, 2048) +
+                "\"";
+    }
+    return params + "]";
+  }));
+  return corpora;
+}
+
+const std::vector<std::string> &messages(const corpus &c) {
+  return c.messages;
+}
+const std::vector<std::string> &raw_strings(const corpus &c) {
+  return c.raw_strings;
+}
+const std::vector<std::string> &strings(const corpus &c) { return c.strings; }
+
+std::vector<benchmark> make_benchmarks() {
+  std::vector<benchmark> benchmarks;
+  // The lookups that on_message() used to make for every call
+  benchmarks.push_back({"json_parse_c", messages, [](const std::string &msg) {
+                          const char *value;
+                          size_t size = 0, total = 0;
+                          for (const char *key : {"id", "method", "params"}) {
+                            json_parse_c(msg.data(), msg.size(), key,
+                                         strlen(key), &value, &size);
+                            total += size;
+                          }
+                          return total;
+                        }});
+  benchmarks.push_back({"json_parse", messages, [](const std::string &msg) {
+                          return json_parse(msg, "id", 0).size() +
+                                 json_parse(msg, "method", 0).size() +
+                                 json_parse(msg, "params", 0).size();
+                        }});
+  // The lookups that on_message() makes now
+  benchmarks.push_back({"tape", messages, [](const std::string &msg) {
+                          static tape t;
+                          t.parse(msg);
+                          return t.find(0, "id") + t.find(0, "method") +
+                                 t.find(0, "params");
+                        }});
+  benchmarks.push_back(
+      {"json_unescape", raw_strings, [](const std::string &raw) {
+         static std::string buffer;
+         std::string_view value;
+         json_unescape(raw, buffer, value);
+         return value.size();
+       }});
+  benchmarks.push_back({"json_escape", strings, [](const std::string &s) {
+                          static std::string out;
+                          out.clear();
+                          json_escape(s, out);
+                          return out.size();
+                        }});
+  return benchmarks;
+}
+
+double percentile(std::vector<double> &samples, double p) {
+  auto n = static_cast<size_t>(p * static_cast<double>(samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+  return samples[n];
+}
+
+// Calls the benchmark on every item, round after round, for at least
+// |min_time| seconds. Latencies include the cost of reading the clock.
+result run(const benchmark &b, const std::vector<std::string> &items,
+           double min_time) {
+  // Warm up caches and the allocator
+  for (const auto &item : items) {
+    sink = b.run(item);
+  }
+  std::vector<double> samples;
+  double total_ns = 0;
+  size_t total_bytes = 0;
+  auto deadline =
+      bench_clock::now() + std::chrono::duration<double>(min_time);
+  do {
+    for (const auto &item : items) {
+      auto start = bench_clock::now();
+      sink = b.run(item);
+      auto end = bench_clock::now();
+      auto ns = std::chrono::duration<double, std::nano>(end - start).count();
+      samples.push_back(ns);
+      total_ns += ns;
+      total_bytes += item.size();
+    }
+  } while (bench_clock::now() < deadline);
+  result r;
+  r.megabytes_per_second =
+      static_cast<double>(total_bytes) / (1024 * 1024) / (total_ns / 1e9);
+  r.p50 = percentile(samples, 0.50);
+  r.p90 = percentile(samples, 0.90);
+  r.p99 = percentile(samples, 0.99);
+  r.calls = samples.size();
+  return r;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double min_time = 0.5;
+  const char *filter = "";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      min_time = atof(argv[++i]);
+    } else if (argv[i][0] != '-') {
+      filter = argv[i];
+    } else {
+      fprintf(stderr, "usage: %s [--min-time SECONDS] [FILTER]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  auto corpora = make_corpora();
+  printf("%-28s %10s %10s %10s %10s %10s\n", "benchmark/corpus", "MB/s",
+         "p50 ns", "p90 ns", "p99 ns", "calls");
+  for (const auto &b : make_benchmarks()) {
+    for (const auto &c : corpora) {
+      auto name = std::string(b.name) + "/" + c.name;
+      const auto &items = b.items(c);
+      if (name.find(filter) == std::string::npos || items.empty()) {
+        continue;
+      }
+      auto r = run(b, items, min_time);
+      printf("%-28s %10.1f %10.0f %10.0f %10.0f %10zu\n", name.c_str(),
+             r.megabytes_per_second, r.p50, r.p90, r.p99, r.calls);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include "webview.hpp"
 
 #include <chrono>
+#include <cstdint>
 #include <string>
 #include <thread>
 
@@ -44,27 +45,21 @@ int main() {
 
   // A binding that increments a value and immediately returns the new value.
   w.bind("increment", [&](const std::string & /*req*/) -> std::string {
-    auto count_string = std::to_string(++count);
-    return "{\"count\": " + count_string + "}";
+    webview::json::writer result;
+    result.begin_object().key("count").value(++count).end_object();
+    return result.take();
   });
 
-  // An binding that creates a new thread and returns the result at a later time.
+  // A binding that runs on the thread pool so that it doesn't block the UI.
+  // The result is delivered on the main thread when it is ready.
   w.bind(
       "compute",
-      [&](const std::string &seq, const std::string &req, void * /*arg*/) {
-        // Create a thread and forget about it for the sake of simplicity.
-        std::thread([&, seq, req] {
-          // Simulate load.
-          std::this_thread::sleep_for(std::chrono::seconds(1));
-          // json_parse() is an implementation detail and is only used here
-          // to provide a working example.
-          auto left = std::stoll(webview::json::json_parse(req, "", 0));
-          auto right = std::stoll(webview::json::json_parse(req, "", 1));
-          auto result = std::to_string(left * right);
-          w.resolve(seq, 0, result);
-        }).detach();
+      [](int64_t left, int64_t right) {
+        // Simulate load.
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        return left * right;
       },
-      nullptr);
+      webview::binding_thread::pool);
 
   w.set_html(html);
   w.run();
@@ -24,6 +24,8 @@
  */
 #pragma once
 
+#include <stddef.h>
+
 #ifndef WEBVIEW_API
 #define WEBVIEW_API extern
 #endif
@@ -111,6 +113,11 @@ WEBVIEW_API void webview_destroy(webview_t w);
 // must destroy the webview.
 WEBVIEW_API void webview_run(webview_t w);
 
+// Handles the events that are ready without waiting for more, for hosts
+// that run a loop of their own instead of webview_run. Returns zero once
+// webview_terminate was called, non-zero otherwise.
+WEBVIEW_API int webview_step(webview_t w);
+
 // Stops the main loop. It is safe to call this function from another other
 // background thread.
 WEBVIEW_API void webview_terminate(webview_t w);
@@ -120,6 +127,30 @@ WEBVIEW_API void webview_terminate(webview_t w);
 WEBVIEW_API void
 webview_dispatch(webview_t w, void (*fn)(webview_t w, void *arg), void *arg);
 
+// What webview_dispatch_with_policy does when the queue is full
+#define WEBVIEW_DISPATCH_BLOCK 0 // Wait for room, except on the main thread
+#define WEBVIEW_DISPATCH_TRY 1   // Don't queue the function
+#define WEBVIEW_DISPATCH_DROP_OLDEST 2 // Drop the oldest queued function
+// Same as webview_dispatch, for queues with a limited capacity. Returns 1 if
+// the function was queued and 0 otherwise. Functions that are dropped are
+// never called, so their arguments must not depend on them to be freed.
+WEBVIEW_API int webview_dispatch_with_policy(webview_t w,
+                                             void (*fn)(webview_t w,
+                                                        void *arg),
+                                             void *arg, int policy);
+
+// Limits the number of functions that wait to be run on the main thread.
+// The default of 0 doesn't limit them. Results, chunks and events that wait
+// to be delivered are limited to the same number: calls of webview_return
+// and the like from other threads wait for room, while calls from the main
+// thread exceed the limit instead.
+WEBVIEW_API void webview_set_dispatch_capacity(webview_t w,
+                                               unsigned int capacity);
+
+// Returns the number of functions that wait to be run on the main thread
+// plus the number of results, chunks and events that wait to be delivered.
+WEBVIEW_API unsigned int webview_dispatch_queue_depth(webview_t w);
+
 // Returns a native window handle pointer. When using GTK backend the pointer
 // is GtkWindow pointer, when using Cocoa backend the pointer is NSWindow
 // pointer, when using Win32 backend the pointer is HWND pointer.
@@ -148,16 +179,28 @@ WEBVIEW_API void webview_navigate(webview_t w, const char *url);
 // Example: webview_set_html(w, "<h1>Hello</h1>");
 WEBVIEW_API void webview_set_html(webview_t w, const char *html);
 
+// Same as webview_set_html, for HTML of the given size that doesn't have to
+// be terminated with a null character.
+WEBVIEW_API void webview_set_html_n(webview_t w, const char *html,
+                                    size_t html_len);
+
 // Injects JavaScript code at the initialization of the new page. Every time
 // the webview will open a the new page - this initialization code will be
 // executed. It is guaranteed that code is executed before window.onload.
 WEBVIEW_API void webview_init(webview_t w, const char *js);
 
+// Same as webview_init, for code of the given size.
+WEBVIEW_API void webview_init_n(webview_t w, const char *js, size_t js_len);
+
 // Evaluates arbitrary JavaScript code. Evaluation happens asynchronously, also
 // the result of the expression is ignored. Use RPC bindings if you want to
 // receive notifications about the results of the evaluation.
 WEBVIEW_API void webview_eval(webview_t w, const char *js);
 
+// Same as webview_eval, for code of the given size. The code is passed on to
+// the engine without being copied first.
+WEBVIEW_API void webview_eval_n(webview_t w, const char *js, size_t js_len);
+
 // Binds a native C callback so that it will appear under the given name as a
 // global JavaScript function. Internally it uses webview_init(). Callback
 // receives a request string and a user-provided argument pointer. Request
@@ -168,9 +211,81 @@ WEBVIEW_API void webview_bind(webview_t w, const char *name,
                                          void *arg),
                               void *arg);
 
+// Same as webview_bind, but the callback receives the sequence number and the
+// request as slices of the message with their sizes. They aren't terminated
+// with a null character and are only valid during the callback.
+WEBVIEW_API void webview_bind_n(webview_t w, const char *name,
+                                void (*fn)(const char *seq, size_t seq_len,
+                                           const char *req, size_t req_len,
+                                           void *arg),
+                                void *arg);
+
+// Binds a native C callback that sends any number of results with
+// webview_send_chunk and finishes with webview_return. In JavaScript the
+// function returns an async iterator over the results, which ends when the
+// call returns with status 0 and throws the result otherwise.
+WEBVIEW_API void webview_bind_stream(webview_t w, const char *name,
+                                     void (*fn)(const char *seq,
+                                                const char *req, void *arg),
+                                     void *arg);
+
+// Binds a function whose calls are queued instead of being passed to a
+// callback, so that hosts can fetch them in bulk with webview_poll_messages.
+// Calls that arrive while the queue is full are rejected.
+WEBVIEW_API void webview_bind_polled(webview_t w, const char *name);
+
+// Sets the number of calls that the queue of webview_bind_polled can hold,
+// 1024 by default. Returns 0 without changing it while calls are queued,
+// including the ones that the last webview_poll_messages returned.
+WEBVIEW_API int webview_set_poll_capacity(webview_t w, size_t calls);
+
+// A call of a function that was bound with webview_bind_polled. The strings
+// are given with their sizes and aren't terminated with a null character.
+typedef struct {
+  // The name of the function
+  const char *method;
+  size_t method_len;
+  // The sequence number to pass to webview_return_n
+  const char *seq;
+  size_t seq_len;
+  // The JSON array of the arguments
+  const char *params;
+  size_t params_len;
+} webview_message_t;
+
+// Moves up to max of the oldest queued calls into buf and returns their
+// number. The strings stay valid until the next call to this function.
+WEBVIEW_API size_t webview_poll_messages(webview_t w, webview_message_t *buf,
+                                         size_t max);
+
 // Removes a native C callback that was previously set by webview_bind.
 WEBVIEW_API void webview_unbind(webview_t w, const char *name);
 
+// Makes the page reject calls of a binding that take longer than the given
+// number of milliseconds, and cancel them. 0 removes the timeout.
+WEBVIEW_API void webview_set_binding_timeout(webview_t w, const char *name,
+                                             unsigned int timeout_ms);
+
+// Returns non-zero if the page stopped waiting for the call with the given
+// sequence number because it timed out or was aborted, in which case the
+// callback can stop early. The call must still be completed with
+// webview_return. Can be called from any thread. A sequence number is only
+// valid until the call is completed: calls that were completed, or aren't
+// known, are reported as cancelled. Calls are forgotten when the callback
+// returns, unless this was called from the callback for them before.
+WEBVIEW_API int webview_is_cancelled(webview_t w, const char *seq);
+
+// Enables or disables slicing messages from the built-in binding stub by
+// their fixed layout instead of parsing them in full. Calls that the stub
+// posts together are split and sliced one by one. Messages in any other
+// layout are still parsed in full. When enabled, the request string passed
+// to callbacks is not validated, so callbacks must handle malformed JSON.
+WEBVIEW_API void webview_trust_rpc_envelopes(webview_t w, int enabled);
+
+// Enables or disables handling each message in an arena that is reused for
+// later messages, instead of allocating its parser state on the heap.
+WEBVIEW_API void webview_use_message_arenas(webview_t w, int enabled);
+
 // Allows to return a value from the native binding. Original request pointer
 // must be provided to help internal RPC engine match requests with responses.
 // If status is zero - result is expected to be a valid JSON result value.
@@ -178,6 +293,50 @@ WEBVIEW_API void webview_unbind(webview_t w, const char *name);
 WEBVIEW_API void webview_return(webview_t w, const char *seq, int status,
                                 const char *result);
 
+// Same as webview_return, for a sequence number and result of the given
+// sizes, such as the slices passed to a callback bound with webview_bind_n.
+WEBVIEW_API void webview_return_n(webview_t w, const char *seq, size_t seq_len,
+                                  int status, const char *result,
+                                  size_t result_len);
+
+// The result of a call for webview_return_batch. The sequence number and the
+// result are given with their sizes and don't need to be terminated with a
+// null character.
+typedef struct {
+  const char *seq;
+  size_t seq_len;
+  // Same as the status of webview_return
+  int status;
+  const char *result;
+  size_t result_len;
+} webview_result_t;
+
+// Same as calling webview_return for each of the n results, but they are
+// all queued at once and delivered to the page by a single script.
+WEBVIEW_API void webview_return_batch(webview_t w,
+                                      const webview_result_t *results,
+                                      size_t n);
+
+// Evaluates n scripts in order as one script on the main thread. The size of
+// each script is given by script_lens, or if script_lens is null, the scripts
+// are terminated with a null character. An uncaught exception stops the
+// scripts that follow. Can be called from any thread. The script is queued
+// like a function given to webview_dispatch, and waits for room in the same
+// way.
+WEBVIEW_API void webview_eval_batch(webview_t w, const char *const *scripts,
+                                    const size_t *script_lens, size_t n);
+
+// Sends a JSON value as the next result of a call to a binding that was
+// bound with webview_bind_stream. Can be called from any thread.
+WEBVIEW_API void webview_send_chunk(webview_t w, const char *seq,
+                                    const char *chunk);
+
+// Sends an event with a JSON payload to the page, where listeners that were
+// added with window.__webview__.addEventListener(event, listener) receive
+// the payload as the detail of the event. Can be called from any thread.
+WEBVIEW_API void webview_emit(webview_t w, const char *event,
+                              const char *payload);
+
 // Get the library's version information.
 // @since 0.10
 WEBVIEW_API const webview_version_info_t *webview_version();
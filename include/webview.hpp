@@ -12,11 +12,28 @@
 #endif
 #endif
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "json_utils.hpp" // Very sketchy since this isn't part of the public API, but it is what it is (for now)
+#include "call_ring.hpp"
+#include "message_arena.hpp"
+#include "thread_pool.hpp"
 
 #if defined(WEBVIEW_GTK)
 #include "webkit2gtk_engine.hpp"
@@ -28,36 +45,503 @@
 
 namespace webview {
 
+namespace detail {
+// Deduces the signature of functions, function pointers and non-generic
+// lambdas. Other types have no members.
+template <typename F, typename = void> struct callable_traits {};
+
+template <typename R, typename... Args> struct callable_traits<R(Args...)> {
+  using result_type = R;
+  using args_type = std::tuple<Args...>;
+};
+
+template <typename R, typename... Args>
+struct callable_traits<R (*)(Args...)> : callable_traits<R(Args...)> {};
+
+template <typename R, typename... Args>
+struct callable_traits<R (*)(Args...) noexcept>
+    : callable_traits<R(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct callable_traits<R (C::*)(Args...)> : callable_traits<R(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct callable_traits<R (C::*)(Args...) const>
+    : callable_traits<R(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct callable_traits<R (C::*)(Args...) noexcept>
+    : callable_traits<R(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct callable_traits<R (C::*)(Args...) const noexcept>
+    : callable_traits<R(Args...)> {};
+
+template <typename F>
+struct callable_traits<F, std::void_t<decltype(&F::operator())>>
+    : callable_traits<decltype(&F::operator())> {};
+
+// Whether a signature takes and returns a single string, i.e. raw JSON
+template <typename R, typename Args>
+struct is_raw_signature : std::false_type {};
+
+template <typename R, typename Arg>
+struct is_raw_signature<R, std::tuple<Arg>>
+    : std::integral_constant<
+          bool, std::is_same<std::decay_t<Arg>, std::string>::value &&
+                    std::is_convertible<R, std::string>::value> {};
+
+// Whether a callable takes slices of the message, i.e. the sequence number
+// and params as std::string_view, and the user-supplied argument
+template <typename F, typename = void>
+struct is_view_binding : std::false_type {};
+
+template <typename F>
+struct is_view_binding<F,
+                       std::void_t<typename callable_traits<F>::args_type>>
+    : std::is_same<typename callable_traits<F>::args_type,
+                   std::tuple<std::string_view, std::string_view, void *>> {
+};
+
+// Typed bindings are callables with a known signature, except those that
+// bind to raw JSON.
+template <typename F, typename = void>
+struct is_typed_binding : std::false_type {};
+
+template <typename F>
+struct is_typed_binding<F,
+                        std::void_t<typename callable_traits<F>::args_type>>
+    : std::integral_constant<
+          bool, !is_raw_signature<typename callable_traits<F>::result_type,
+                                  typename callable_traits<F>::args_type>::
+                    value> {};
+} // namespace detail
+
+// Where the handler of a binding runs
+enum class binding_thread {
+  // The thread that runs the main loop
+  ui,
+  // A worker of the thread pool that the webview shares between bindings.
+  // Results are still delivered on the main loop.
+  pool
+};
+
+// What dispatch() does when the queue is full
+enum class dispatch_policy {
+  // Wait until there is room. Calls on the main thread don't wait, since
+  // the queue can't drain while they do, and exceed the capacity instead.
+  block,
+  // Don't queue the function
+  try_push,
+  // Drop the oldest function in the queue to make room
+  drop_oldest
+};
+
+// The result of a call, for webview::resolve_batch()
+struct call_result {
+  std::string_view seq;
+  int status;
+  std::string_view result;
+};
+
+// A call of a binding that was bound with webview::bind_polled()
+struct polled_call {
+  std::string_view method;
+  std::string_view seq;
+  std::string_view params;
+};
+
+// Tells whether the page stopped waiting for the result of a call, because
+// the call timed out or was aborted. Can be checked from any thread.
+class cancel_token {
+public:
+  // A token that is never cancelled
+  cancel_token() = default;
+
+  bool cancelled() const {
+    return m_cancelled && m_cancelled->load(std::memory_order_relaxed);
+  }
+
+private:
+  friend class webview;
+  explicit cancel_token(std::shared_ptr<std::atomic<bool>> cancelled)
+      : m_cancelled(std::move(cancelled)) {}
+
+  std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
 class webview : public browser_engine {
 public:
   webview(bool debug = false, void *wnd = nullptr);
+  ~webview();
 
   void navigate(const std::string &url);
 
+  void set_html(std::string_view html);
+
+  // Queues a function to be run on the main thread. Returns false if the
+  // function wasn't queued because the queue is full.
+  bool dispatch(std::function<void()> f,
+                dispatch_policy policy = dispatch_policy::block);
+
+  // Limits the number of functions that wait to be run by dispatch(). The
+  // default of 0 doesn't limit them. Results, chunks and events that wait
+  // to be delivered are limited to the same number: other threads that
+  // queue them wait for room, the main thread exceeds the limit instead.
+  void set_dispatch_capacity(size_t capacity);
+
+  // The number of functions that wait to be run by dispatch() plus the
+  // number of results, chunks and events that wait to be delivered, for
+  // producers that throttle themselves
+  size_t dispatch_queue_depth() const;
+
   using binding_t = std::function<void(std::string, std::string, void *)>;
+  using params_binding_t = std::function<void(
+      const std::string &, const json::params_view &, void *)>;
+  using view_binding_t =
+      std::function<void(std::string_view, std::string_view, void *)>;
   class binding_ctx_t {
   public:
     binding_ctx_t(binding_t callback, void *arg);
+    binding_ctx_t(params_binding_t callback, void *arg);
+    binding_ctx_t(view_binding_t callback, void *arg);
     // This function is called upon execution of the bound JS function
     binding_t callback;
+    // Alternatively, this function is called with the already parsed params
+    params_binding_t params_callback;
+    // Or this one, with slices of the message
+    view_binding_t view_callback;
     // This user-supplied argument is passed to the callback
     void *arg;
+    // The number that the JS stub sends instead of the name of the binding,
+    // see m_binding_ids
+    uint64_t id = 0;
+    binding_thread thread = binding_thread::ui;
+    // Calls that take longer are rejected by the page. 0 means no timeout.
+    unsigned timeout_ms = 0;
+    // Whether the binding sends its results with send_chunk()
+    bool streaming = false;
+    // Whether calls are completed after the callback returned, so that
+    // they stay in progress even if the callback didn't ask for their
+    // cancel_token
+    bool deferred = false;
   };
 
   using sync_binding_t = std::function<std::string(std::string)>;
   // Synchronous bind
-  void bind(const std::string &name, sync_binding_t fn);
+  void bind(const std::string &name, sync_binding_t fn,
+            binding_thread thread = binding_thread::ui);
 
   // Asynchronous bind
-  void bind(const std::string &name, binding_t fn, void *arg);
+  void bind(const std::string &name, binding_t fn, void *arg,
+            binding_thread thread = binding_thread::ui);
+
+  // Asynchronous bind with random access to the params that were sent
+  void bind(const std::string &name, params_binding_t fn, void *arg,
+            binding_thread thread = binding_thread::ui);
+
+  // Asynchronous bind of a function that takes the sequence number and the
+  // params as slices of the message, which are only valid during the call,
+  // instead of copies of them
+  template <typename F, typename std::enable_if<detail::is_view_binding<
+                            std::decay_t<F>>::value>::type * = nullptr>
+  void bind(const std::string &name, F &&fn, void *arg,
+            binding_thread thread = binding_thread::ui) {
+    bind_view(name, view_binding_t(std::forward<F>(fn)), arg, thread);
+  }
+
+  // Synchronous bind of a function with typed parameters, for example
+  // int(double, std::string_view, std::vector<int>). Params are decoded and
+  // the result is encoded with json::value_traits. Calls with params that
+  // can't be decoded are rejected. A cancel_token as the last parameter
+  // receives the token of the call instead of a param.
+  template <typename F, typename std::enable_if<detail::is_typed_binding<
+                            std::decay_t<F>>::value>::type * = nullptr>
+  void bind(const std::string &name, F &&fn,
+            binding_thread thread = binding_thread::ui) {
+    using args_type =
+        typename detail::callable_traits<std::decay_t<F>>::args_type;
+    bind(
+        name,
+        params_binding_t([this, fn = std::forward<F>(fn)](
+                             const std::string &seq,
+                             const json::params_view &params, void *) mutable {
+          call_typed(fn, seq, params, static_cast<args_type *>(nullptr),
+                     std::make_index_sequence<
+                         std::tuple_size<args_type>::value>{});
+        }),
+        nullptr, thread);
+  }
+
+  // Binds a function that sends any number of results with send_chunk()
+  // and finishes with resolve(). The page receives the chunks through an
+  // async iterator, e.g. for await (const row of window.rows()) {...}.
+  // The iterator ends when the call is resolved with status 0; otherwise
+  // it throws the result. Leaving the loop early cancels the call.
+  void bind_stream(const std::string &name, binding_t fn, void *arg,
+                   binding_thread thread = binding_thread::ui);
+  void bind_stream(const std::string &name, params_binding_t fn, void *arg,
+                   binding_thread thread = binding_thread::ui);
+
+  // Binds a function whose calls are queued instead of being passed to a
+  // callback, for hosts that fetch them in bulk with poll_calls(). Calls
+  // that arrive while the queue is full are rejected.
+  void bind_polled(const std::string &name);
+
+  // Sets the number of polled calls that can be queued, 1024 by default.
+  // Returns false without changing it while calls are queued, including
+  // the ones that the last poll handed out.
+  bool set_poll_capacity(size_t calls);
+
+  // Moves up to |max| of the oldest queued calls into |out| and returns
+  // their number. The views stay valid until the next call. The calls are
+  // completed with resolve() as usual. Can be called from any thread.
+  size_t poll_calls(polled_call *out, size_t max);
+
+  // Same as above, but passes the calls to f(const polled_call &) instead
+  template <typename F> size_t poll_calls(size_t max, F &&f) {
+    return m_polled_calls.poll(max, [&f](std::string_view method,
+                                         std::string_view seq,
+                                         std::string_view params) {
+      f(polled_call{method, seq, params});
+    });
+  }
 
   void unbind(const std::string &name);
 
-  void resolve(const std::string &seq, int status, const std::string &result);
+  // Calls of the binding that take longer than this are rejected by the
+  // page and cancelled. Calls can also be given their own timeout or an
+  // AbortSignal with window.name.with({timeout: ms, signal: signal})(...).
+  void set_binding_timeout(const std::string &name, unsigned timeout_ms);
+
+  // Returns the token that tells whether the page stopped waiting for the
+  // call with the given sequence number. Can be called from any thread
+  // until the call is resolved. A sequence number is only valid until then:
+  // the token of a call that was resolved or isn't known is cancelled.
+  // Calls of bindings that return before they are resolved are only kept
+  // if their token was asked for before that, or if they are streaming or
+  // polled.
+  cancel_token get_cancel_token(const std::string &seq);
+
+  // Sets the number of threads that run bindings with binding_thread::pool.
+  // The default of 0 starts one per core. The pool is started by the first
+  // call to such a binding, so this has no effect after that.
+  void set_thread_pool_size(size_t threads);
+
+  // When enabled, calls in the exact layout produced by the binding stub
+  // are sliced by position instead of being parsed in full, including the
+  // calls that the stub posts together. Params that are passed to bindings
+  // as text are not validated in this mode.
+  void trust_rpc_envelopes(bool enabled);
+
+  // When enabled, each message is parsed into an arena that is reset once
+  // all of its calls returned, and typed bindings decode their arguments and
+  // encode their results there too, instead of on the global heap. Pool
+  // threads use arenas of their own. Has no effect without <memory_resource>.
+  void use_message_arenas(bool enabled);
+
+  // Results are queued and all of the results that are queued by the time
+  // the main loop gets to them are delivered in order by a single script.
+  // The result is copied into the queue once, so it can be a slice. Calls
+  // with a result that isn't valid JSON are rejected instead, and unknown
+  // kinds of sequence numbers are ignored.
+  void resolve(std::string_view seq, int status, std::string_view result);
+
+  // Same as above, for sequence numbers that were kept as numbers
+  void resolve(uint64_t seq, int status, std::string_view result);
+
+  // Same as calling resolve() for each of the results, but they are all
+  // queued at once and delivered by the same script
+  void resolve_batch(const call_result *results, size_t n);
+
+  // Evaluates the scripts in order as a single script on the main thread,
+  // so one dispatch is needed for all of them. An uncaught exception stops
+  // the scripts that follow. Can be called from any thread. The script is
+  // queued like a function given to dispatch(), so it counts towards the
+  // capacity, and false is returned if the policy didn't let it be queued.
+  bool eval_batch(const std::string_view *scripts, size_t n,
+                  dispatch_policy policy = dispatch_policy::block);
+
+  // Sends a JSON value to the page as the next result of a streaming call.
+  // Chunks are delivered in order along with the queued results. Chunks
+  // that aren't valid JSON are dropped.
+  void send_chunk(const std::string &seq, const std::string &chunk);
+
+  // Sends an event with a JSON payload to the page, where listeners that
+  // were added with window.__webview__.addEventListener(event, listener)
+  // receive it as the detail of a CustomEvent. Events are delivered in
+  // order along with the queued results. Events with a payload that isn't
+  // valid JSON are dropped. Can be called from any thread.
+  void emit(const std::string &event, const std::string &payload);
 
 private:
   void on_message(const std::string &msg);
+  void on_message(const std::string &msg, json::tape &tape,
+                  json::params_view &params);
+  // Reads a piece of a call that was too long to be posted at once, and
+  // makes the call once its last piece has arrived
+  void on_message_piece(std::string_view piece, bool last, json::tape &tape,
+                        json::params_view &params);
+
+  // Runs the functions that were queued by the time it starts
+  void drain_dispatch_queue();
+
+  template <typename T, typename Buffer>
+  bool decode_arg(const std::string &seq, const json::params_view &params,
+                  size_t i, T &value, Buffer &buffer) {
+    if constexpr (std::is_same<T, cancel_token>::value) {
+      value = get_cancel_token(seq);
+      return true;
+    } else {
+      auto index = i < params.size() ? params.index(i) : json::tape::npos;
+      return json::value_traits<T>::decode(params.source(), index, value,
+                                           buffer);
+    }
+  }
+
+  template <typename F, typename... Args, size_t... I>
+  void call_typed(F &fn, const std::string &seq,
+                  const json::params_view &params, std::tuple<Args...> *,
+                  std::index_sequence<I...>) {
+    std::tuple<std::decay_t<Args>...> args;
+    // Views into decoded strings point here. Like the result, they are kept
+    // in the arena of the message if there is one.
+    auto allocator = detail::arena_allocator();
+    [[maybe_unused]] std::array<detail::arena_string, sizeof...(Args)> buffers{
+        ((void)I, detail::arena_string(allocator))...};
+    bool decoded =
+        (decode_arg(seq, params, I, std::get<I>(args), buffers[I]) && ...);
+    if (!decoded) {
+      resolve(seq, 1, json::json_escape("Invalid arguments"));
+      return;
+    }
+    using result_type = decltype(fn(std::forward<Args>(std::get<I>(args))...));
+    if constexpr (std::is_void<result_type>::value) {
+      fn(std::forward<Args>(std::get<I>(args))...);
+      resolve(seq, 0, "null");
+    } else {
+      json::basic_writer<detail::arena_string> result(allocator);
+      json::value_traits<std::decay_t<result_type>>::encode(
+          result, fn(std::forward<Args>(std::get<I>(args))...));
+      // The writer only produces valid JSON
+      enqueue_result(seq, 0, result.str());
+    }
+  }
+
+  // A call that is in progress
+  struct call_state {
+    // Created when the token of the call is asked for
+    std::shared_ptr<std::atomic<bool>> cancelled;
+  };
+  using call_map = std::unordered_map<uint64_t, call_state>;
+
+  void bind(const std::string &name, binding_ctx_t ctx);
+  // Returns the binding with the given id, or null if it was removed
+  const binding_ctx_t *find_binding(uint64_t id) const;
+  void bind_view(const std::string &name, view_binding_t fn, void *arg,
+                 binding_thread thread);
+
+  void queue_binding(const std::string &name, const binding_ctx_t &context);
+  // Appends "name":id, or "name":[id,timeout], to a table of bindings
+  static void append_binding(std::string &table, const std::string &name,
+                             const binding_ctx_t &context);
+  void flush_bindings();
+  void update_bindings_script();
+  void enqueue_result(std::string_view seq, int status,
+                      std::string_view result);
+  // Queues function(seq, flag value); for the next flush. |last| is set
+  // for the call that finishes the RPC call.
+  void enqueue_call(std::string_view function, std::string_view seq,
+                    std::string_view flag, std::string_view value, bool last);
+  // Waits until the queue of results has room, see set_dispatch_capacity()
+  void wait_for_result_space(std::unique_lock<std::mutex> &lock);
+  // Same as above, with m_resolve_mutex held and without scheduling a flush
+  void append_call(std::string_view function, std::string_view seq,
+                   std::string_view flag, std::string_view value, bool last);
+  void flush_resolves();
+  // Called when the page stops waiting for a call
+  void cancel(const std::string &seq);
+  // Adds a call to the calls in progress, and removes one with
+  // m_resolve_mutex held
+  void begin_call(uint64_t seq);
+  void end_call(call_map::iterator call);
+  // Called when the binding of a call returns. The call is forgotten
+  // unless it is deferred or its token was asked for, since nothing could
+  // check whether it was cancelled otherwise.
+  void leave_call(uint64_t seq, bool deferred);
+
+  // Calls the binding for the call at the given index of the tape, which is
+  // either [method id,seq,[params]] or {"id":seq,"method":name,"params":[]}
+  void call(json::tape &tape, size_t index, json::params_view &params);
+
+  // Calls a binding with the given params. If they aren't on the tape yet,
+  // i.e. |args_index| is npos, they are parsed into it if needed.
+  void call(const binding_ctx_t &context, std::string_view seq,
+            std::string_view args, json::tape &tape, size_t args_index,
+            json::params_view &params);
+
+  // Runs a call on the thread pool with a copy of the binding and params
+  void call_on_pool(const binding_ctx_t &context, const std::string &seq,
+                    std::string args);
 
   std::map<std::string, binding_ctx_t> bindings;
+  // Bindings by the low 32 bits of their id. The high bits count how often
+  // the slot was reused, so that calls that the page made to a removed
+  // binding can't reach the one that took its place.
+  struct binding_slot {
+    const binding_ctx_t *context;
+    uint32_t generation;
+  };
+  std::vector<binding_slot> m_binding_ids;
+  std::vector<uint32_t> m_free_binding_ids;
+  // Names and ids of new bindings that the page doesn't know about yet
+  std::string m_pending_bindings;
+  bool m_bindings_scheduled = false;
+  // Handle of the user script that registers all bindings, or 0
+  size_t m_bindings_script = 0;
+  // Parser state is reused across messages unless a binding re-enters
+  json::tape m_tape;
+  json::params_view m_params;
+  bool m_parsing = false;
+  // The call that is arriving in pieces, see on_message_piece()
+  json::incremental_reader m_piece_reader;
+  std::string m_piece_method;
+  std::string m_piece_seq;
+  std::string m_piece_params;
+  bool m_trust_rpc_envelopes = false;
+  bool m_use_message_arenas = false;
+  // Arenas that are reused for messages, see use_message_arenas()
+  detail::arena_pool m_arenas;
+  // Calls to settle promises that are waiting for the next flush. The
+  // mutex also guards the cancellation state below.
+  mutable std::mutex m_resolve_mutex;
+  std::condition_variable m_resolve_space;
+  std::string m_pending_resolves;
+  // Number of calls in m_pending_resolves
+  size_t m_pending_count = 0;
+  bool m_resolve_scheduled = false;
+  // Calls that are in progress by sequence number. Entries are removed
+  // when the call is resolved or cancelled, or when its binding returns,
+  // see leave_call(). Their nodes are kept for the next calls.
+  call_map m_calls;
+  std::vector<call_map::node_type> m_free_call_nodes;
+  // Functions for the main thread. Internal tasks skip this queue and go to
+  // the engine, so they are never dropped or delayed by a full queue.
+  mutable std::mutex m_dispatch_mutex;
+  std::condition_variable m_dispatch_space;
+  std::deque<std::function<void()>> m_dispatch_queue;
+  // Also limits the queued results, so it is read without either mutex
+  std::atomic<size_t> m_dispatch_capacity{0};
+  // Set when the webview is destroyed, so that nothing waits for room
+  // that the main loop won't make any more
+  std::atomic<bool> m_closing{false};
+  bool m_drain_scheduled = false;
+  std::thread::id m_main_thread = std::this_thread::get_id();
+  size_t m_thread_pool_size = 0;
+  // Calls of polled bindings, see bind_polled()
+  detail::call_ring m_polled_calls{1024};
+  // Declared last so that running pool tasks finish before anything they
+  // use is destroyed
+  std::unique_ptr<detail::thread_pool> m_thread_pool;
 };
 } // namespace webview
\ No newline at end of file
@@ -7,9 +7,9 @@ FLAGS="-Wall -Wextra -pedantic -I$DIR"
 CFLAGS="-std=c99 $FLAGS"
 
 if [ "$(uname)" = "Darwin" ]; then
-	CXXFLAGS="-DWEBVIEW_COCOA -std=c++11 $FLAGS -framework WebKit"
+	CXXFLAGS="-DWEBVIEW_COCOA -std=c++17 $FLAGS -framework WebKit"
 else
-	CXXFLAGS="-DWEBVIEW_GTK -std=c++11 $FLAGS $(pkg-config --cflags --libs gtk+-3.0 webkit2gtk-4.0)"
+	CXXFLAGS="-DWEBVIEW_GTK -std=c++17 $FLAGS $(pkg-config --cflags --libs gtk+-3.0 webkit2gtk-4.0)"
 fi
 
 if command -v clang-format >/dev/null 2>&1 ; then
@@ -18,6 +18,10 @@ WEBVIEW_API void webview_run(webview_t w) {
   static_cast<webview::webview *>(w)->run();
 }
 
+WEBVIEW_API int webview_step(webview_t w) {
+  return static_cast<webview::webview *>(w)->step() ? 1 : 0;
+}
+
 WEBVIEW_API void webview_terminate(webview_t w) {
   static_cast<webview::webview *>(w)->terminate();
 }
@@ -27,6 +31,29 @@ WEBVIEW_API void webview_dispatch(webview_t w, void (*fn)(webview_t, void *),
   static_cast<webview::webview *>(w)->dispatch([=]() { fn(w, arg); });
 }
 
+WEBVIEW_API int webview_dispatch_with_policy(webview_t w,
+                                             void (*fn)(webview_t, void *),
+                                             void *arg, int policy) {
+  auto p = webview::dispatch_policy::block;
+  if (policy == WEBVIEW_DISPATCH_TRY) {
+    p = webview::dispatch_policy::try_push;
+  } else if (policy == WEBVIEW_DISPATCH_DROP_OLDEST) {
+    p = webview::dispatch_policy::drop_oldest;
+  }
+  return static_cast<webview::webview *>(w)->dispatch(
+      [=]() { fn(w, arg); }, p);
+}
+
+WEBVIEW_API void webview_set_dispatch_capacity(webview_t w,
+                                               unsigned int capacity) {
+  static_cast<webview::webview *>(w)->set_dispatch_capacity(capacity);
+}
+
+WEBVIEW_API unsigned int webview_dispatch_queue_depth(webview_t w) {
+  return static_cast<unsigned int>(
+      static_cast<webview::webview *>(w)->dispatch_queue_depth());
+}
+
 WEBVIEW_API void *webview_get_window(webview_t w) {
   return static_cast<webview::webview *>(w)->window();
 }
@@ -48,19 +75,62 @@ WEBVIEW_API void webview_set_html(webview_t w, const char *html) {
   static_cast<webview::webview *>(w)->set_html(html);
 }
 
+WEBVIEW_API void webview_set_html_n(webview_t w, const char *html,
+                                    size_t html_len) {
+  static_cast<webview::webview *>(w)->set_html({html, html_len});
+}
+
 WEBVIEW_API void webview_init(webview_t w, const char *js) {
   static_cast<webview::webview *>(w)->init(js);
 }
 
+WEBVIEW_API void webview_init_n(webview_t w, const char *js, size_t js_len) {
+  // The engine keeps its own copy of the script
+  static_cast<webview::webview *>(w)->init(std::string(js, js_len));
+}
+
 WEBVIEW_API void webview_eval(webview_t w, const char *js) {
   static_cast<webview::webview *>(w)->eval(js);
 }
 
+WEBVIEW_API void webview_eval_n(webview_t w, const char *js, size_t js_len) {
+  static_cast<webview::webview *>(w)->eval({js, js_len});
+}
+
 WEBVIEW_API void webview_bind(webview_t w, const char *name,
                               void (*fn)(const char *seq, const char *req,
                                          void *arg),
                               void *arg) {
   static_cast<webview::webview *>(w)->bind(
+      name,
+      [=](std::string_view seq, std::string_view req, void *arg) {
+        // Both slices are terminated with a null character in one copy
+        std::string buffer;
+        buffer.reserve(seq.size() + req.size() + 2);
+        buffer.append(seq).append(1, '\0').append(req).append(1, '\0');
+        fn(buffer.data(), buffer.data() + seq.size() + 1, arg);
+      },
+      arg);
+}
+
+WEBVIEW_API void webview_bind_n(webview_t w, const char *name,
+                                void (*fn)(const char *seq, size_t seq_len,
+                                           const char *req, size_t req_len,
+                                           void *arg),
+                                void *arg) {
+  static_cast<webview::webview *>(w)->bind(
+      name,
+      [=](std::string_view seq, std::string_view req, void *arg) {
+        fn(seq.data(), seq.size(), req.data(), req.size(), arg);
+      },
+      arg);
+}
+
+WEBVIEW_API void webview_bind_stream(webview_t w, const char *name,
+                                     void (*fn)(const char *seq,
+                                                const char *req, void *arg),
+                                     void *arg) {
+  static_cast<webview::webview *>(w)->bind_stream(
       name,
       [=](const std::string &seq, const std::string &req, void *arg) {
         fn(seq.c_str(), req.c_str(), arg);
@@ -72,11 +142,86 @@ WEBVIEW_API void webview_unbind(webview_t w, const char *name) {
   static_cast<webview::webview *>(w)->unbind(name);
 }
 
+WEBVIEW_API void webview_set_binding_timeout(webview_t w, const char *name,
+                                             unsigned int timeout_ms) {
+  static_cast<webview::webview *>(w)->set_binding_timeout(name, timeout_ms);
+}
+
+WEBVIEW_API int webview_is_cancelled(webview_t w, const char *seq) {
+  return static_cast<webview::webview *>(w)->get_cancel_token(seq).cancelled();
+}
+
+WEBVIEW_API void webview_trust_rpc_envelopes(webview_t w, int enabled) {
+  static_cast<webview::webview *>(w)->trust_rpc_envelopes(enabled != 0);
+}
+
+WEBVIEW_API void webview_use_message_arenas(webview_t w, int enabled) {
+  static_cast<webview::webview *>(w)->use_message_arenas(enabled != 0);
+}
+
 WEBVIEW_API void webview_return(webview_t w, const char *seq, int status,
                                 const char *result) {
   static_cast<webview::webview *>(w)->resolve(seq, status, result);
 }
 
+WEBVIEW_API void webview_return_n(webview_t w, const char *seq, size_t seq_len,
+                                  int status, const char *result,
+                                  size_t result_len) {
+  static_cast<webview::webview *>(w)->resolve({seq, seq_len}, status,
+                                              {result, result_len});
+}
+
+WEBVIEW_API void webview_return_batch(webview_t w,
+                                      const webview_result_t *results,
+                                      size_t n) {
+  std::vector<webview::call_result> batch;
+  batch.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    const auto &r = results[i];
+    batch.push_back(
+        {{r.seq, r.seq_len}, r.status, {r.result, r.result_len}});
+  }
+  static_cast<webview::webview *>(w)->resolve_batch(batch.data(), n);
+}
+
+WEBVIEW_API void webview_eval_batch(webview_t w, const char *const *scripts,
+                                    const size_t *script_lens, size_t n) {
+  std::vector<std::string_view> batch;
+  batch.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    batch.push_back(script_lens ? std::string_view(scripts[i], script_lens[i])
+                                : std::string_view(scripts[i]));
+  }
+  static_cast<webview::webview *>(w)->eval_batch(batch.data(), n);
+}
+
+WEBVIEW_API void webview_bind_polled(webview_t w, const char *name) {
+  static_cast<webview::webview *>(w)->bind_polled(name);
+}
+
+WEBVIEW_API int webview_set_poll_capacity(webview_t w, size_t calls) {
+  return static_cast<webview::webview *>(w)->set_poll_capacity(calls);
+}
+
+WEBVIEW_API size_t webview_poll_messages(webview_t w, webview_message_t *buf,
+                                         size_t max) {
+  return static_cast<webview::webview *>(w)->poll_calls(
+      max, [&buf](const webview::polled_call &c) {
+        *buf++ = {c.method.data(), c.method.size(), c.seq.data(),
+                  c.seq.size(),    c.params.data(), c.params.size()};
+      });
+}
+
+WEBVIEW_API void webview_send_chunk(webview_t w, const char *seq,
+                                    const char *chunk) {
+  static_cast<webview::webview *>(w)->send_chunk(seq, chunk);
+}
+
+WEBVIEW_API void webview_emit(webview_t w, const char *event,
+                              const char *payload) {
+  static_cast<webview::webview *>(w)->emit(event, payload);
+}
+
 namespace webview {
 // The library's version information.
 constexpr const webview_version_info_t library_version_info{
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace webview {
+namespace detail {
+
+// Binding calls that wait for the host to poll for them, in a ring of a
+// fixed number of slots. The calls that were handed out by poll() stay
+// valid until the next poll, so their slots are only reused after that.
+// Slots are created by the first push and keep their storage, so the ring
+// stops allocating once it has been filled. Can be used from any thread.
+class call_ring {
+public:
+  explicit call_ring(size_t capacity)
+      : m_capacity(std::max<size_t>(capacity, 1)) {}
+
+  call_ring(const call_ring &other) = delete;
+  call_ring &operator=(const call_ring &other) = delete;
+
+  // Copies the call into the next free slot. Returns false if there is none.
+  bool push(std::string_view method, std::string_view seq,
+            std::string_view params) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_count == m_capacity) {
+      return false;
+    }
+    if (m_slots.empty()) {
+      m_slots.resize(m_capacity);
+    }
+    auto &slot = m_slots[(m_head + m_count) % m_slots.size()];
+    slot.text.assign(method.data(), method.size());
+    slot.text.append(seq.data(), seq.size());
+    slot.text.append(params.data(), params.size());
+    slot.method_size = method.size();
+    slot.seq_size = seq.size();
+    ++m_count;
+    return true;
+  }
+
+  // Frees the calls of the previous poll and passes up to |max| of the
+  // oldest calls to f(method, seq, params). Returns the number of calls.
+  template <typename F> size_t poll(size_t max, F &&f) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_count == 0) {
+      return 0;
+    }
+    m_head = (m_head + m_lent) % m_slots.size();
+    m_count -= m_lent;
+    m_lent = std::min(max, m_count);
+    for (size_t i = 0; i < m_lent; i++) {
+      const auto &slot = m_slots[(m_head + i) % m_slots.size()];
+      std::string_view text = slot.text;
+      f(text.substr(0, slot.method_size),
+        text.substr(slot.method_size, slot.seq_size),
+        text.substr(slot.method_size + slot.seq_size));
+    }
+    return m_lent;
+  }
+
+  // Changes the number of slots. Returns false without changing it while
+  // calls are queued, including the ones handed out by the last poll.
+  bool set_capacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_count != 0) {
+      return false;
+    }
+    m_capacity = std::max<size_t>(capacity, 1);
+    m_slots.clear();
+    m_slots.shrink_to_fit();
+    m_head = 0;
+    return true;
+  }
+
+private:
+  struct slot {
+    // The method, sequence number and params, one after the other
+    std::string text;
+    size_t method_size = 0;
+    size_t seq_size = 0;
+  };
+
+  std::mutex m_mutex;
+  size_t m_capacity;
+  std::vector<slot> m_slots;
+  // Index of the oldest call and the number of calls, including the ones
+  // that were handed out by the last poll
+  size_t m_head = 0;
+  size_t m_count = 0;
+  size_t m_lent = 0;
+};
+
+} // namespace detail
+} // namespace webview
@@ -0,0 +1,415 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define WEBVIEW_JSON_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(WEBVIEW_JSON_SIMD_X86) || defined(_M_ARM64) ||                    \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define WEBVIEW_JSON_LITTLE_ENDIAN
+#endif
+
+#if defined(WEBVIEW_JSON_SIMD_X86) &&                                         \
+    (defined(__GNUC__) || defined(__clang__))
+#define WEBVIEW_JSON_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define WEBVIEW_JSON_TARGET_AVX2
+#endif
+
+namespace webview {
+namespace json {
+
+// Vectorized helpers that let the parsers skip over runs of bytes that can't
+// change their state. Every kernel returns the number of bytes that may be
+// skipped; the byte at that offset (if any) must be handled by the caller.
+namespace simd {
+
+// Skips plain ASCII string content, i.e. stops at quotes, backslashes,
+// control characters and anything that isn't ASCII.
+inline size_t scan_string_scalar(const char *s, size_t n) {
+  size_t i = 0;
+  for (; i < n; i++) {
+    auto c = static_cast<unsigned char>(s[i]);
+    if (c < 32 || c > 126 || c == '"' || c == '\\') {
+      break;
+    }
+  }
+  return i;
+}
+
+// Skips the body of a literal, i.e. stops at whitespace, delimiters, quotes,
+// backslashes and anything that isn't printable ASCII.
+inline size_t scan_literal_scalar(const char *s, size_t n) {
+  size_t i = 0;
+  for (; i < n; i++) {
+    auto c = static_cast<unsigned char>(s[i]);
+    if (c <= 32 || c > 126 || c == ',' || c == ']' || c == '}' || c == ':' ||
+        c == '"' || c == '\\') {
+      break;
+    }
+  }
+  return i;
+}
+
+// Skips bytes that can be copied into a JSON string literal as they are,
+// i.e. stops at quotes, backslashes, control characters and at 0xE2, which
+// starts the line and paragraph separators that need escaping in scripts.
+inline size_t scan_escape_scalar(const char *s, size_t n) {
+  size_t i = 0;
+  for (; i < n; i++) {
+    auto c = static_cast<unsigned char>(s[i]);
+    if (c < 32 || c == '"' || c == '\\' || c == 0xe2) {
+      break;
+    }
+  }
+  return i;
+}
+
+// Skips decimal digits.
+inline size_t scan_digits_scalar(const char *s, size_t n) {
+  size_t i = 0;
+  while (i < n && s[i] >= '0' && s[i] <= '9') {
+    i++;
+  }
+  return i;
+}
+
+// Returns the value of exactly eight decimal digits.
+inline uint32_t parse_eight_digits(const char *s) {
+#ifdef WEBVIEW_JSON_LITTLE_ENDIAN
+  // Combines neighbouring digits pairwise within a single register: first
+  // into eight-bit pairs, then into 16-bit quadruples and finally into the
+  // 32-bit result.
+  uint64_t v;
+  std::memcpy(&v, s, sizeof(v));
+  v -= 0x3030303030303030;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000ff000000ff) * (100 + (1000000ull << 32))) +
+       (((v >> 16) & 0x000000ff000000ff) * (1 + (10000ull << 32)))) >>
+      32;
+  return static_cast<uint32_t>(v);
+#else
+  uint32_t v = 0;
+  for (int i = 0; i < 8; i++) {
+    v = v * 10 + static_cast<uint32_t>(s[i] - '0');
+  }
+  return v;
+#endif
+}
+
+#ifdef WEBVIEW_JSON_SIMD_X86
+
+inline unsigned first_bit(uint64_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+inline uint64_t bit_mask(__m128i m) {
+  return static_cast<uint16_t>(_mm_movemask_epi8(m));
+}
+
+WEBVIEW_JSON_TARGET_AVX2
+inline uint64_t bit_mask(__m256i m) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(m));
+}
+
+// Byte classes of one block, one bit per byte.
+struct string_block {
+  // Quotes, backslashes, control characters, DEL and invalid lead bytes
+  uint64_t stop;
+  // UTF-8 continuation bytes (0x80-0xBF)
+  uint64_t continuation;
+  // Lead bytes of sequences with at least two, three or four bytes
+  uint64_t lead2;
+  uint64_t lead3;
+  uint64_t lead4;
+};
+
+// Validates the UTF-8 structure of a block of string content with the same
+// rules as the json_parse_c state machine. Continuation bytes still expected
+// from the next block are carried over in |carry|. Skipping must always end
+// on a character boundary, so |boundary| tracks the last safe offset.
+inline void scan_string_block(const string_block &b, unsigned width,
+                              size_t offset, uint64_t &carry, size_t &boundary,
+                              bool &done) {
+  auto full = (uint64_t{1} << width) - 1;
+  auto required = (b.lead2 << 1) | (b.lead3 << 2) | (b.lead4 << 3) | carry;
+  auto error = (required ^ b.continuation) & full;
+  if ((b.stop | error) == 0) {
+    carry = required >> width;
+    if (carry == 0) {
+      boundary = offset + width;
+    }
+    return;
+  }
+  done = true;
+  auto stop = b.stop != 0 ? first_bit(b.stop) : width;
+  auto first_error = error != 0 ? first_bit(error) : width;
+  // A stop byte that isn't expected to be a continuation byte is always on a
+  // character boundary, whereas errors are left for the state machine.
+  if (stop < first_error) {
+    boundary = offset + stop;
+  }
+}
+
+inline size_t scan_string_sse2(const char *s, size_t n) {
+  const auto quote = _mm_set1_epi8('"');
+  const auto backslash = _mm_set1_epi8('\\');
+  const auto del = _mm_set1_epi8(0x7f);
+  size_t i = 0;
+  size_t boundary = 0;
+  uint64_t carry = 0;
+  bool done = false;
+  for (; i + 16 <= n && !done; i += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    // Bytes are compared as signed values so that 0x80-0xff become negative
+    auto unsigned_v = _mm_xor_si128(v, _mm_set1_epi8(-128));
+    auto control = _mm_cmplt_epi8(unsigned_v, _mm_set1_epi8(32 - 128));
+    auto non_ascii = _mm_cmplt_epi8(v, _mm_setzero_si128());
+    auto continuation = _mm_cmplt_epi8(v, _mm_set1_epi8(-64));
+    auto lead3 =
+        _mm_and_si128(non_ascii, _mm_cmpgt_epi8(v, _mm_set1_epi8(-33)));
+    auto lead4 = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(-17)),
+                               _mm_cmplt_epi8(v, _mm_set1_epi8(-9)));
+    auto invalid =
+        _mm_and_si128(non_ascii, _mm_cmpgt_epi8(v, _mm_set1_epi8(-10)));
+    auto stop = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_or_si128(_mm_or_si128(control, _mm_cmpeq_epi8(v, del)), invalid));
+    string_block b{bit_mask(stop), bit_mask(continuation),
+                   bit_mask(_mm_andnot_si128(continuation, non_ascii)),
+                   bit_mask(lead3), bit_mask(lead4)};
+    scan_string_block(b, 16, i, carry, boundary, done);
+  }
+  if (!done && carry == 0) {
+    boundary += scan_string_scalar(s + i, n - i);
+  }
+  return boundary;
+}
+
+WEBVIEW_JSON_TARGET_AVX2
+inline size_t scan_string_avx2(const char *s, size_t n) {
+  const auto quote = _mm256_set1_epi8('"');
+  const auto backslash = _mm256_set1_epi8('\\');
+  const auto del = _mm256_set1_epi8(0x7f);
+  size_t i = 0;
+  size_t boundary = 0;
+  uint64_t carry = 0;
+  bool done = false;
+  for (; i + 32 <= n && !done; i += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    // AVX2 has no signed less-than, so the operands are swapped instead
+    auto unsigned_v = _mm256_xor_si256(v, _mm256_set1_epi8(-128));
+    auto control = _mm256_cmpgt_epi8(_mm256_set1_epi8(32 - 128), unsigned_v);
+    auto non_ascii = _mm256_cmpgt_epi8(_mm256_setzero_si256(), v);
+    auto continuation = _mm256_cmpgt_epi8(_mm256_set1_epi8(-64), v);
+    auto lead3 = _mm256_and_si256(non_ascii,
+                                  _mm256_cmpgt_epi8(v, _mm256_set1_epi8(-33)));
+    auto lead4 = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-17)),
+                                  _mm256_cmpgt_epi8(_mm256_set1_epi8(-9), v));
+    auto invalid = _mm256_and_si256(
+        non_ascii, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(-10)));
+    auto stop = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                        _mm256_cmpeq_epi8(v, backslash)),
+        _mm256_or_si256(_mm256_or_si256(control, _mm256_cmpeq_epi8(v, del)),
+                        invalid));
+    string_block b{bit_mask(stop), bit_mask(continuation),
+                   bit_mask(_mm256_andnot_si256(continuation, non_ascii)),
+                   bit_mask(lead3), bit_mask(lead4)};
+    scan_string_block(b, 32, i, carry, boundary, done);
+  }
+  if (!done && carry == 0) {
+    boundary += scan_string_scalar(s + i, n - i);
+  }
+  return boundary;
+}
+
+inline size_t scan_literal_sse2(const char *s, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    // Anything up to a space as well as 0x80-0xff are less than 33 if signed
+    auto stop = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(33)),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+    for (char c : {',', ']', '}', ':', '"', '\\'}) {
+      stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+    }
+    auto mask = bit_mask(stop);
+    if (mask != 0) {
+      return i + first_bit(mask);
+    }
+  }
+  return i + scan_literal_scalar(s + i, n - i);
+}
+
+WEBVIEW_JSON_TARGET_AVX2
+inline size_t scan_literal_avx2(const char *s, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    auto stop = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(33), v),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+    for (char c : {',', ']', '}', ':', '"', '\\'}) {
+      auto match = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+      stop = _mm256_or_si256(stop, match);
+    }
+    auto mask = bit_mask(stop);
+    if (mask != 0) {
+      return i + first_bit(mask);
+    }
+  }
+  return i + scan_literal_scalar(s + i, n - i);
+}
+
+inline size_t scan_escape_sse2(const char *s, size_t n) {
+  const auto separator = _mm_set1_epi8(static_cast<char>(0xe2));
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    auto unsigned_v = _mm_xor_si128(v, _mm_set1_epi8(-128));
+    auto stop = _mm_or_si128(
+        _mm_or_si128(_mm_cmplt_epi8(unsigned_v, _mm_set1_epi8(32 - 128)),
+                     _mm_cmpeq_epi8(v, separator)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+    auto mask = bit_mask(stop);
+    if (mask != 0) {
+      return i + first_bit(mask);
+    }
+  }
+  return i + scan_escape_scalar(s + i, n - i);
+}
+
+WEBVIEW_JSON_TARGET_AVX2
+inline size_t scan_escape_avx2(const char *s, size_t n) {
+  const auto separator = _mm256_set1_epi8(static_cast<char>(0xe2));
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    auto unsigned_v = _mm256_xor_si256(v, _mm256_set1_epi8(-128));
+    auto stop = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(32 - 128), unsigned_v),
+            _mm256_cmpeq_epi8(v, separator)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))));
+    auto mask = bit_mask(stop);
+    if (mask != 0) {
+      return i + first_bit(mask);
+    }
+  }
+  return i + scan_escape_scalar(s + i, n - i);
+}
+
+inline size_t scan_digits_sse2(const char *s, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    // Bytes from 0x80 are negative and therefore never digits
+    auto digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                               _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    auto mask = bit_mask(digit) ^ 0xffff;
+    if (mask != 0) {
+      return i + first_bit(mask);
+    }
+  }
+  return i + scan_digits_scalar(s + i, n - i);
+}
+
+WEBVIEW_JSON_TARGET_AVX2
+inline size_t scan_digits_avx2(const char *s, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    auto digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    auto mask = bit_mask(digit) ^ 0xffffffff;
+    if (mask != 0) {
+      return i + first_bit(mask);
+    }
+  }
+  return i + scan_digits_scalar(s + i, n - i);
+}
+
+#endif /* WEBVIEW_JSON_SIMD_X86 */
+
+inline bool cpu_supports_avx2() {
+#if defined(WEBVIEW_JSON_SIMD_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  // The OS must also save the AVX registers on context switches
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 ||
+      (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif defined(WEBVIEW_JSON_SIMD_X86)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+struct kernels {
+  size_t (*scan_string)(const char *s, size_t n);
+  size_t (*scan_literal)(const char *s, size_t n);
+  size_t (*scan_escape)(const char *s, size_t n);
+  size_t (*scan_digits)(const char *s, size_t n);
+};
+
+// Picks the widest kernels that the CPU supports, once per process
+inline const kernels &active_kernels() {
+#ifdef WEBVIEW_JSON_SIMD_X86
+  static const kernels selected =
+      cpu_supports_avx2()
+          ? kernels{scan_string_avx2, scan_literal_avx2, scan_escape_avx2,
+                    scan_digits_avx2}
+          : kernels{scan_string_sse2, scan_literal_sse2, scan_escape_sse2,
+                    scan_digits_sse2};
+#else
+  static const kernels selected{scan_string_scalar, scan_literal_scalar,
+                                scan_escape_scalar, scan_digits_scalar};
+#endif
+  return selected;
+}
+
+inline size_t scan_string(const char *s, size_t n) {
+  return active_kernels().scan_string(s, n);
+}
+
+inline size_t scan_literal(const char *s, size_t n) {
+  return active_kernels().scan_literal(s, n);
+}
+
+inline size_t scan_escape(const char *s, size_t n) {
+  return active_kernels().scan_escape(s, n);
+}
+
+inline size_t scan_digits(const char *s, size_t n) {
+  return active_kernels().scan_digits(s, n);
+}
+
+} // namespace simd
+} // namespace json
+} // namespace webview
@@ -1,14 +1,46 @@
 #pragma once
 
+#include <cerrno>
+#include <charconv>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <functional>
+#include <limits>
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+
+// Polymorphic allocators are missing from some standard libraries that
+// otherwise support C++17, e.g. on older versions of macOS
+#if defined(__cpp_lib_memory_resource)
+#define WEBVIEW_HAVE_PMR
+#endif
+
+#include "json_simd.hpp"
 
 namespace webview {
 
 namespace json {
 
+// Containers of the parser, which can allocate from a memory resource that
+// is given to the constructor when polymorphic allocators are available
+#ifdef WEBVIEW_HAVE_PMR
+template <typename T> using arena_vector = std::pmr::vector<T>;
+#else
+template <typename T> using arena_vector = std::vector<T>;
+#endif
+
 inline int json_parse_c(const char *s, size_t sz, const char *key, size_t keysz,
                         const char **value, size_t *valuesz) {
   enum {
@@ -35,6 +67,16 @@ inline int json_parse_c(const char *s, size_t sz, const char *key, size_t keysz,
   }
 
   for (; sz > 0; s++, sz--) {
+    // Runs of bytes that can't change the state are skipped in bulk
+    if (state == JSON_STATE_STRING || state == JSON_STATE_LITERAL) {
+      auto skip = state == JSON_STATE_STRING ? simd::scan_string(s, sz)
+                                             : simd::scan_literal(s, sz);
+      s += skip;
+      sz -= skip;
+      if (sz == 0) {
+        break;
+      }
+    }
     enum {
       JSON_ACTION_NONE,
       JSON_ACTION_START,
@@ -151,66 +193,272 @@ inline int json_parse_c(const char *s, size_t sz, const char *key, size_t keysz,
   return -1;
 }
 
+// Appends |s| to |out| as a quoted JSON string. Runs of bytes that don't
+// need escaping are copied in bulk. U+2028 and U+2029 are escaped as well
+// since they can't appear in string literals of older JavaScript engines.
+template <typename String> void json_escape(std::string_view s, String &out) {
+  static constexpr char hex[] = "0123456789abcdef";
+  out.reserve(out.size() + s.size() + 2);
+  out += '"';
+  size_t i = 0;
+  while (true) {
+    auto n = simd::scan_escape(s.data() + i, s.size() - i);
+    out.append(s.data() + i, n);
+    i += n;
+    if (i == s.size()) {
+      break;
+    }
+    auto c = static_cast<unsigned char>(s[i++]);
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\b':
+      out += "\\b";
+      break;
+    case '\f':
+      out += "\\f";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    case 0xe2:
+      if (s.size() - i >= 2 && s[i] == '\x80' &&
+          (s[i + 1] == '\xa8' || s[i + 1] == '\xa9')) {
+        out += s[i + 1] == '\xa8' ? "\\u2028" : "\\u2029";
+        i += 2;
+      } else {
+        out += static_cast<char>(c);
+      }
+      break;
+    default:
+      out += "\\u00";
+      out += hex[c >> 4];
+      out += hex[c & 0xf];
+      break;
+    }
+  }
+  out += '"';
+}
+
 inline std::string json_escape(const std::string &s) {
-  // TODO: implement
-  return '"' + s + '"';
+  std::string out;
+  json_escape(s, out);
+  return out;
 }
 
+inline int json_parse_hex4(const char *s, unsigned int &code_unit) {
+  code_unit = 0;
+  for (int i = 0; i < 4; i++) {
+    auto c = s[i];
+    code_unit <<= 4;
+    if (c >= '0' && c <= '9') {
+      code_unit |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      code_unit |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      code_unit |= c - 'A' + 10;
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Returns the number of continuation bytes that follow the byte |c| in a
+// string, or -1 if |c| can't appear in a string as it is. Quotes and
+// backslashes must be handled before.
+inline int json_utf8_continuation_bytes(unsigned char c) {
+  if (c < 32) {
+    return -1;
+  }
+  if (c < 128) {
+    return 0;
+  }
+  if (c >= 192 && c < 224) {
+    return 1;
+  }
+  if (c >= 224 && c < 240) {
+    return 2;
+  }
+  if (c >= 240 && c < 245) {
+    return 3;
+  }
+  return -1;
+}
+
+// Writes the UTF-8 encoding of |code_point| to |out| and returns its size
+inline int json_encode_utf8(unsigned int code_point, char out[4]) {
+  if (code_point < 0x80) {
+    out[0] = static_cast<char>(code_point);
+    return 1;
+  }
+  if (code_point < 0x800) {
+    out[0] = static_cast<char>(0xc0 | (code_point >> 6));
+    out[1] = static_cast<char>(0x80 | (code_point & 0x3f));
+    return 2;
+  }
+  if (code_point < 0x10000) {
+    out[0] = static_cast<char>(0xe0 | (code_point >> 12));
+    out[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+    out[2] = static_cast<char>(0x80 | (code_point & 0x3f));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xf0 | (code_point >> 18));
+  out[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+  out[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+  out[3] = static_cast<char>(0x80 | (code_point & 0x3f));
+  return 4;
+}
+
+// Decodes the quoted JSON string |s| of size |n| in a single pass. If |out|
+// is null only the decoded size is computed, otherwise |out| must have room
+// for n - 1 bytes (the decoded value is never longer than the escaped one,
+// plus a null terminator). \u escapes are decoded to UTF-8, surrogate pairs
+// included; lone surrogates become U+FFFD. Returns -1 if |s| isn't valid.
 inline int json_unescape(const char *s, size_t n, char *out) {
-  int r = 0;
-  if (*s++ != '"') {
+  if (n < 2 || s[0] != '"' || s[n - 1] != '"') {
     return -1;
   }
-  while (n > 2) {
-    char c = *s;
-    if (c == '\\') {
-      s++;
-      n--;
-      switch (*s) {
-      case 'b':
-        c = '\b';
-        break;
-      case 'f':
-        c = '\f';
-        break;
-      case 'n':
-        c = '\n';
-        break;
-      case 'r':
-        c = '\r';
-        break;
-      case 't':
-        c = '\t';
-        break;
-      case '\\':
-        c = '\\';
-        break;
-      case '/':
-        c = '/';
-        break;
-      case '\"':
-        c = '\"';
-        break;
-      default: // TODO: support unicode decoding
+  const char *end = s + n - 1;
+  s++;
+  int r = 0;
+  while (s < end) {
+    // Everything up to the next escape sequence is copied verbatim
+    auto escape = static_cast<const char *>(memchr(s, '\\', end - s));
+    auto run = (escape != nullptr ? escape : end) - s;
+    if (out != nullptr) {
+      memcpy(out + r, s, run);
+    }
+    r += static_cast<int>(run);
+    s += run;
+    if (s == end) {
+      break;
+    }
+    if (++s == end) {
+      return -1;
+    }
+    char c;
+    switch (*s++) {
+    case 'b':
+      c = '\b';
+      break;
+    case 'f':
+      c = '\f';
+      break;
+    case 'n':
+      c = '\n';
+      break;
+    case 'r':
+      c = '\r';
+      break;
+    case 't':
+      c = '\t';
+      break;
+    case '\\':
+      c = '\\';
+      break;
+    case '/':
+      c = '/';
+      break;
+    case '\"':
+      c = '\"';
+      break;
+    case 'u': {
+      unsigned int code_point;
+      if (end - s < 4 || json_parse_hex4(s, code_point) != 0) {
         return -1;
       }
+      s += 4;
+      if (code_point >= 0xd800 && code_point <= 0xdbff) {
+        unsigned int low;
+        if (end - s >= 6 && s[0] == '\\' && s[1] == 'u' &&
+            json_parse_hex4(s + 2, low) == 0 && low >= 0xdc00 &&
+            low <= 0xdfff) {
+          code_point = 0x10000 + ((code_point - 0xd800) << 10) +
+                       (low - 0xdc00);
+          s += 6;
+        } else {
+          code_point = 0xfffd;
+        }
+      } else if (code_point >= 0xdc00 && code_point <= 0xdfff) {
+        code_point = 0xfffd;
+      }
+      char utf8[4];
+      auto utf8_sz = json_encode_utf8(code_point, utf8);
+      if (out != nullptr) {
+        memcpy(out + r, utf8, utf8_sz);
+      }
+      r += utf8_sz;
+      continue;
+    }
+    default:
+      return -1;
     }
     if (out != nullptr) {
-      *out++ = c;
+      out[r] = c;
     }
-    s++;
-    n--;
     r++;
   }
-  if (*s != '"') {
-    return -1;
-  }
   if (out != nullptr) {
-    *out = '\0';
+    out[r] = '\0';
   }
   return r;
 }
 
+// Decodes the quoted JSON string |s| into |value|. Strings without escape
+// sequences are returned as a view into |s| without copying, anything else
+// is decoded into |buffer|, which can be reused between calls. Returns the
+// decoded size or -1 if |s| isn't valid.
+template <typename Buffer>
+int json_unescape(std::string_view s, Buffer &buffer,
+                  std::string_view &value) {
+  value = {};
+  if (s.size() < 2 || s.front() != '"' || s.back() != '"') {
+    return -1;
+  }
+  auto body = s.substr(1, s.size() - 2);
+  if (memchr(body.data(), '\\', body.size()) == nullptr) {
+    value = body;
+    return static_cast<int>(body.size());
+  }
+  buffer.resize(s.size() - 1);
+  auto n = json_unescape(s.data(), s.size(), &buffer[0]);
+  if (n < 0) {
+    return -1;
+  }
+  buffer.resize(n);
+  value = buffer;
+  return n;
+}
+
+// Returns strings in their unescaped form and everything else verbatim
+inline std::string json_decode_value(const char *value, size_t value_sz) {
+  if (value == nullptr || value_sz == 0) {
+    return "";
+  }
+  if (value[0] != '"') {
+    return {value, value_sz};
+  }
+  // The decoded string is never longer, so it is decoded in place
+  std::string result(value_sz - 1, '\0');
+  auto n = json_unescape(value, value_sz, &result[0]);
+  if (n <= 0) {
+    return "";
+  }
+  result.resize(n);
+  return result;
+}
+
 inline std::string json_parse(const std::string &s, const std::string &key,
                               const int index) {
   const char *value;
@@ -221,21 +469,1412 @@ inline std::string json_parse(const std::string &s, const std::string &key,
     json_parse_c(s.c_str(), s.length(), key.c_str(), key.length(), &value,
                  &value_sz);
   }
-  if (value != nullptr) {
-    if (value[0] != '"') {
-      return {value, value_sz};
+  return json_decode_value(value, value_sz);
+}
+
+// Builds JSON text by appending to a string, which is either owned by the
+// writer or supplied by the caller so that its capacity can be reused, e.g.
+//
+//   writer w;
+//   w.begin_object().key("count").value(42).end_object();
+//   resolve(seq, 0, w.take());
+//
+// Commas and colons are inserted automatically; it is up to the caller to
+// balance objects and arrays and to only write keys inside of objects.
+// The text is kept in a std::string by writer and in |String| otherwise.
+template <typename String> class basic_writer {
+public:
+  basic_writer() : m_out(&m_buffer) {}
+  explicit basic_writer(String &buffer) : m_out(&buffer) {}
+  // Allocates the text that the writer owns with |allocator|
+  explicit basic_writer(const typename String::allocator_type &allocator)
+      : m_buffer(allocator), m_out(&m_buffer) {}
+
+  basic_writer(const basic_writer &) = delete;
+  basic_writer &operator=(const basic_writer &) = delete;
+
+  basic_writer &begin_object() { return open('{'); }
+  basic_writer &end_object() { return close('}'); }
+  basic_writer &begin_array() { return open('['); }
+  basic_writer &end_array() { return close(']'); }
+
+  basic_writer &key(std::string_view k) {
+    separate();
+    json_escape(k, *m_out);
+    *m_out += ':';
+    m_needs_comma = false;
+    return *this;
+  }
+
+  basic_writer &value(std::string_view s) {
+    separate();
+    json_escape(s, *m_out);
+    return *this;
+  }
+
+  basic_writer &value(const char *s) { return value(std::string_view(s)); }
+
+  basic_writer &value(const std::string &s) {
+    return value(std::string_view(s));
+  }
+
+  basic_writer &value(bool b) { return raw(b ? "true" : "false"); }
+
+  // Characters are strings of their own rather than numbers
+  basic_writer &value(char c) { return value(std::string_view(&c, 1)); }
+
+  basic_writer &value(std::nullptr_t) { return raw("null"); }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value &&
+                              !std::is_same<T, bool>::value &&
+                              !std::is_same<T, char>::value,
+                          basic_writer &>::type
+  value(T n) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), n);
+    return raw({buffer, static_cast<size_t>(result.ptr - buffer)});
+  }
+
+  // Non-finite numbers are written as null, the same as JSON.stringify()
+  template <typename T>
+  typename std::enable_if<std::is_floating_point<T>::value,
+                          basic_writer &>::type
+  value(T n) {
+    if (!std::isfinite(n)) {
+      return raw("null");
     }
-    int n = json_unescape(value, value_sz, nullptr);
-    if (n > 0) {
-      char *decoded = new char[n + 1];
-      json_unescape(value, value_sz, decoded);
-      std::string result(decoded, n);
-      delete[] decoded;
-      return result;
+    char buffer[32];
+#if defined(__cpp_lib_to_chars)
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), n);
+    auto size = static_cast<size_t>(result.ptr - buffer);
+#else
+    auto written = static_cast<size_t>(
+        snprintf(buffer, sizeof(buffer), "%.17g", static_cast<double>(n)));
+    // snprintf() writes the decimal point of the current locale, which may
+    // be a comma or take more than one byte
+    size_t size = 0;
+    for (size_t i = 0; i < written; i++) {
+      auto c = buffer[i];
+      if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == 'e') {
+        buffer[size++] = c;
+      } else if (size == 0 || buffer[size - 1] != '.') {
+        buffer[size++] = '.';
+      }
     }
+#endif
+    return raw({buffer, size});
   }
-  return "";
+
+  // Appends text that is already valid JSON as the next value
+  basic_writer &raw(std::string_view json) {
+    separate();
+    m_out->append(json.data(), json.size());
+    m_needs_comma = true;
+    return *this;
+  }
+
+  const String &str() const { return *m_out; }
+
+  // Moves the text out of the writer, which can be used again afterwards
+  String take() {
+    String result = std::move(*m_out);
+    clear();
+    return result;
+  }
+
+  void clear() {
+    m_out->clear();
+    m_needs_comma = false;
+  }
+
+private:
+  void separate() {
+    if (m_needs_comma) {
+      *m_out += ',';
+    }
+    m_needs_comma = true;
+  }
+
+  basic_writer &open(char c) {
+    separate();
+    *m_out += c;
+    m_needs_comma = false;
+    return *this;
+  }
+
+  basic_writer &close(char c) {
+    *m_out += c;
+    m_needs_comma = true;
+    return *this;
+  }
+
+  String m_buffer;
+  String *m_out;
+  bool m_needs_comma = false;
+};
+
+using writer = basic_writer<std::string>;
+
+// Returns whether |s| is one of true, false, null or a valid number
+inline bool json_is_literal(std::string_view s) {
+  if (s == "true" || s == "false" || s == "null") {
+    return true;
+  }
+  size_t i = 0;
+  auto digits = [&]() {
+    size_t start = i;
+    while (i < s.size() && s[i] >= '0' && s[i] <= '9') {
+      i++;
+    }
+    return i > start;
+  };
+  if (i < s.size() && s[i] == '-') {
+    i++;
+  }
+  if (i < s.size() && s[i] == '0') {
+    i++;
+  } else if (!digits()) {
+    return false;
+  }
+  if (i < s.size() && s[i] == '.') {
+    i++;
+    if (!digits()) {
+      return false;
+    }
+  }
+  if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+    i++;
+    if (i < s.size() && (s[i] == '+' || s[i] == '-')) {
+      i++;
+    }
+    if (!digits()) {
+      return false;
+    }
+  }
+  return i == s.size();
 }
 
+// Returns the value of |n| decimal digits, of which there must be at most 19
+inline uint64_t json_parse_digits(const char *s, size_t n) {
+  uint64_t v = 0;
+  for (; n >= 8; s += 8, n -= 8) {
+    v = v * 100000000 + simd::parse_eight_digits(s);
+  }
+  for (; n > 0; s++, n--) {
+    v = v * 10 + static_cast<uint64_t>(*s - '0');
+  }
+  return v;
+}
+
+// Finds the parts of the number in |s|. Returns false unless all of |s| is a
+// valid JSON number.
+inline bool json_scan_number(std::string_view s, bool &negative,
+                             size_t &int_start, size_t &int_digits,
+                             bool &integral) {
+  size_t i = 0;
+  negative = i < s.size() && s[i] == '-';
+  if (negative) {
+    i++;
+  }
+  int_start = i;
+  int_digits = simd::scan_digits(s.data() + i, s.size() - i);
+  if (int_digits == 0 || (int_digits > 1 && s[i] == '0')) {
+    return false;
+  }
+  i += int_digits;
+  integral = true;
+  if (i < s.size() && s[i] == '.') {
+    i++;
+    auto digits = simd::scan_digits(s.data() + i, s.size() - i);
+    if (digits == 0) {
+      return false;
+    }
+    i += digits;
+    integral = false;
+  }
+  if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+    i++;
+    if (i < s.size() && (s[i] == '+' || s[i] == '-')) {
+      i++;
+    }
+    auto digits = simd::scan_digits(s.data() + i, s.size() - i);
+    if (digits == 0) {
+      return false;
+    }
+    i += digits;
+    integral = false;
+  }
+  return i == s.size();
+}
+
+// Converts a JSON number that has no fraction or exponent and fits into an
+// int64_t. Returns false otherwise.
+inline bool json_parse_number(std::string_view s, int64_t &out) {
+  bool negative, integral;
+  size_t start, digits;
+  if (!json_scan_number(s, negative, start, digits, integral) || !integral ||
+      digits > 19) {
+    return false;
+  }
+  auto v = json_parse_digits(s.data() + start, digits);
+  auto limit = static_cast<uint64_t>(INT64_MAX) + (negative ? 1 : 0);
+  if (v > limit) {
+    return false;
+  }
+  if (negative && v != 0) {
+    out = -static_cast<int64_t>(v - 1) - 1;
+  } else {
+    out = static_cast<int64_t>(v);
+  }
+  return true;
+}
+
+// Converts a JSON number to the nearest double. Returns false if |s| isn't a
+// valid JSON number or its magnitude is out of the range of double.
+inline bool json_parse_number(std::string_view s, double &out) {
+  bool negative, integral;
+  size_t start, digits;
+  if (!json_scan_number(s, negative, start, digits, integral)) {
+    return false;
+  }
+  // Integers below 2^53 convert exactly
+  if (integral && digits <= 15) {
+    auto v = static_cast<double>(json_parse_digits(s.data() + start, digits));
+    out = negative ? -v : v;
+    return true;
+  }
+#if defined(__cpp_lib_to_chars)
+  auto result = std::from_chars(s.data(), s.data() + s.size(), out);
+  return result.ec == std::errc{};
+#else
+  // strtod() needs a terminated copy
+  char buffer[64];
+  std::string long_buffer;
+  char *text = buffer;
+  if (s.size() >= sizeof(buffer)) {
+    long_buffer.assign(s.data(), s.size());
+    text = &long_buffer[0];
+  } else {
+    memcpy(buffer, s.data(), s.size());
+    buffer[s.size()] = '\0';
+  }
+  errno = 0;
+  out = strtod(text, nullptr);
+  // Subnormal results are also reported as range errors
+  return errno != ERANGE || (out != 0 && !std::isinf(out));
+#endif
+}
+
+// Slices a call in the exact layout that JSON.stringify() gives to the array
+// made by the binding stub: [method id,seq,[params]]. Returns false for
+// anything else, in which case the call has to be parsed in full. The params
+// are only delimited, not validated.
+inline bool json_slice_call(std::string_view msg, std::string_view &id,
+                            std::string_view &seq, std::string_view &params) {
+  if (msg.size() < 8 || msg[0] != '[' || msg.substr(msg.size() - 2) != "]]") {
+    return false;
+  }
+  size_t i = 1;
+  for (auto *number : {&id, &seq}) {
+    auto digits = simd::scan_digits(msg.data() + i, msg.size() - i);
+    if (digits == 0 || digits > 19 || msg[i + digits] != ',') {
+      return false;
+    }
+    *number = msg.substr(i, digits);
+    i += digits + 1;
+  }
+  if (msg[i] != '[') {
+    return false;
+  }
+  params = msg.substr(i, msg.size() - 1 - i);
+  return true;
+}
+
+// Returns the offset just past the array or object that starts at |i|, or
+// npos if it doesn't end. Only brackets outside of strings are counted, so
+// this is for text in the layout of JSON.stringify() that isn't validated.
+inline size_t json_slice_value_end(std::string_view s, size_t i) {
+  size_t depth = 0;
+  while (i < s.size()) {
+    auto c = s[i];
+    if (c == '"') {
+      for (i++;; i++) {
+        i += simd::scan_string(s.data() + i, s.size() - i);
+        if (i >= s.size()) {
+          return std::string_view::npos;
+        }
+        if (s[i] == '"') {
+          break;
+        }
+        // Skips the escaped character, or a byte that isn't plain ASCII
+        if (s[i] == '\\' && ++i == s.size()) {
+          return std::string_view::npos;
+        }
+      }
+    } else if (c == '[' || c == '{') {
+      depth++;
+    } else if (c == ']' || c == '}') {
+      if (depth-- <= 1) {
+        return depth == 0 ? i + 1 : std::string_view::npos;
+      }
+    }
+    i++;
+  }
+  return std::string_view::npos;
+}
+
+// Splits the calls that the stub posts together, [call,call,...], and
+// passes each of them to |each| as a slice, for json_slice_call(). Returns
+// false without calling |each| unless |msg| looks like such a batch. Calls
+// are passed as they are found, so a batch that turns out to be malformed
+// is cut short after the last call that could be delimited.
+template <typename F> bool json_slice_batch(std::string_view msg, F &&each) {
+  if (msg.size() < 4 || msg[0] != '[' || msg[1] != '[' ||
+      msg.substr(msg.size() - 2) != "]]") {
+    return false;
+  }
+  for (size_t i = 1;;) {
+    auto end = json_slice_value_end(msg, i);
+    if (end == std::string_view::npos || end >= msg.size()) {
+      return i > 1;
+    }
+    each(msg.substr(i, end - i));
+    if (msg[end] != ',' || end + 1 >= msg.size() || msg[end + 1] != '[') {
+      return true;
+    }
+    i = end + 1;
+  }
+}
+
+enum class token_type : unsigned char { object, array, string, literal };
+
+struct token {
+  token_type type;
+  // Offset of the first byte of the value within the parsed text
+  size_t offset;
+  // Size of the value in bytes, including quotes and brackets
+  size_t size;
+  // Index of the first token that isn't part of this value
+  size_t next;
+  // Number of direct children (keys and values both count for objects)
+  size_t children;
+};
+
+// Tokenizes a JSON document in a single pass and records every value as a
+// token, in document order, so that lookups don't have to rescan the text.
+// The tape only stores offsets, so the text must outlive it.
+class tape {
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  tape() = default;
+#ifdef WEBVIEW_HAVE_PMR
+  // Allocates tokens from |resource|, which must outlive the tape
+  explicit tape(std::pmr::memory_resource *resource)
+      : m_tokens(resource), m_stack(resource) {}
+#endif
+
+  bool parse(const char *s, size_t n) {
+    enum class expect {
+      value,
+      value_or_end,
+      key,
+      key_or_end,
+      colon,
+      comma_or_end,
+      done
+    } state = expect::value;
+
+    m_data = s;
+    m_size = n;
+    m_tokens.clear();
+    m_stack.clear();
+
+    size_t i = 0;
+    while (true) {
+      while (i < n && is_whitespace(s[i])) {
+        i++;
+      }
+      if (i == n) {
+        break;
+      }
+      auto c = s[i];
+      switch (state) {
+      case expect::value_or_end:
+      case expect::value:
+        if (c == ']' && state == expect::value_or_end) {
+          if (!close(i, token_type::array)) {
+            return false;
+          }
+          break;
+        }
+        if (c == '{' || c == '[') {
+          m_stack.push_back(m_tokens.size());
+          auto type = c == '{' ? token_type::object : token_type::array;
+          m_tokens.push_back({type, i, 0, 0, 0});
+          state = c == '{' ? expect::key_or_end : expect::value_or_end;
+          i++;
+          continue;
+        }
+        if (c == '"') {
+          if (!push_string(i)) {
+            return false;
+          }
+        } else if (!push_literal(i)) {
+          return false;
+        }
+        break;
+      case expect::key_or_end:
+      case expect::key:
+        if (c == '}' && state == expect::key_or_end) {
+          if (!close(i, token_type::object)) {
+            return false;
+          }
+          break;
+        }
+        if (c != '"' || !push_string(i)) {
+          return false;
+        }
+        m_tokens[m_stack.back()].children++;
+        state = expect::colon;
+        continue;
+      case expect::colon:
+        if (c != ':') {
+          return false;
+        }
+        state = expect::value;
+        i++;
+        continue;
+      case expect::comma_or_end:
+        if (c == ',') {
+          state = m_tokens[m_stack.back()].type == token_type::object
+                      ? expect::key
+                      : expect::value;
+          i++;
+          continue;
+        }
+        if ((c != '}' && c != ']') ||
+            !close(i, c == '}' ? token_type::object : token_type::array)) {
+          return false;
+        }
+        break;
+      case expect::done:
+        return false;
+      }
+      // A complete value has been consumed at this point
+      if (m_stack.empty()) {
+        state = expect::done;
+      } else {
+        m_tokens[m_stack.back()].children++;
+        state = expect::comma_or_end;
+      }
+    }
+    return state == expect::done;
+  }
+
+  bool parse(std::string_view s) { return parse(s.data(), s.size()); }
+
+  bool empty() const { return m_tokens.empty(); }
+  size_t size() const { return m_tokens.size(); }
+  const token &operator[](size_t index) const { return m_tokens[index]; }
+
+  // Returns the raw text of the value, including quotes and brackets
+  std::string_view text(size_t index) const {
+    const auto &t = m_tokens[index];
+    return {m_data + t.offset, t.size};
+  }
+
+  // Returns strings in their unescaped form and everything else verbatim
+  std::string str(size_t index) const {
+    const auto &t = m_tokens[index];
+    return json_decode_value(m_data + t.offset, t.size);
+  }
+
+  // Same as above, but without copying values that don't contain escape
+  // sequences. Others are decoded into |buffer|, which must outlive the view.
+  template <typename Buffer>
+  std::string_view str(size_t index, Buffer &buffer) const {
+    auto value = text(index);
+    if (m_tokens[index].type == token_type::string) {
+      json_unescape(text(index), buffer, value);
+    }
+    return value;
+  }
+
+  // Converts the number at |index|. See json_parse_number() for which
+  // numbers can be represented by each type.
+  template <typename T> bool number(size_t index, T &out) const {
+    return index < m_tokens.size() &&
+           m_tokens[index].type == token_type::literal &&
+           json_parse_number(text(index), out);
+  }
+
+  // Converts every element of |array|, which must only contain numbers, into
+  // |out|. Returns the number of elements, or npos if any element isn't a
+  // number or there are more than |capacity|. |out| is unspecified on error.
+  template <typename T>
+  size_t numbers(size_t array, T *out, size_t capacity) const {
+    if (array >= m_tokens.size() ||
+        m_tokens[array].type != token_type::array ||
+        m_tokens[array].children > capacity) {
+      return npos;
+    }
+    // Numbers have no children, so they are stored back to back
+    const auto &a = m_tokens[array];
+    if (a.next - array - 1 != a.children) {
+      return npos;
+    }
+    for (size_t i = 0; i < a.children; i++) {
+      if (!number(array + 1 + i, out[i])) {
+        return npos;
+      }
+    }
+    return a.children;
+  }
+
+  // Same as above, but replaces the contents of |out|
+  template <typename T>
+  bool numbers(size_t array, std::vector<T> &out) const {
+    if (array >= m_tokens.size() ||
+        m_tokens[array].type != token_type::array) {
+      return false;
+    }
+    out.resize(m_tokens[array].children);
+    return numbers(array, out.data(), out.size()) != npos;
+  }
+
+  // Returns the index of the value stored under the given key, or npos
+  size_t find(size_t object, std::string_view key) const {
+    if (object >= m_tokens.size() ||
+        m_tokens[object].type != token_type::object) {
+      return npos;
+    }
+    for (size_t i = object + 1; i < m_tokens[object].next;
+         i = m_tokens[i + 1].next) {
+      const auto &k = m_tokens[i];
+      if (k.size - 2 == key.size() &&
+          memcmp(m_data + k.offset + 1, key.data(), key.size()) == 0) {
+        return i + 1;
+      }
+    }
+    return npos;
+  }
+
+  // Returns the index of the n-th element of the given array, or npos
+  size_t at(size_t array, size_t n) const {
+    if (array >= m_tokens.size() ||
+        m_tokens[array].type != token_type::array ||
+        n >= m_tokens[array].children) {
+      return npos;
+    }
+    size_t i = array + 1;
+    for (; n > 0; n--) {
+      i = m_tokens[i].next;
+    }
+    return i;
+  }
+
+private:
+  static bool is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  }
+
+  static bool is_hex_digit(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+           (c >= 'A' && c <= 'F');
+  }
+
+  static bool is_delimiter(char c) {
+    return is_whitespace(c) || c == ',' || c == ']' || c == '}' || c == ':';
+  }
+
+  bool close(size_t &i, token_type type) {
+    if (m_stack.empty() || m_tokens[m_stack.back()].type != type) {
+      return false;
+    }
+    auto &t = m_tokens[m_stack.back()];
+    t.size = i + 1 - t.offset;
+    t.next = m_tokens.size();
+    m_stack.pop_back();
+    i++;
+    return true;
+  }
+
+  bool push_string(size_t &i) {
+    auto s = reinterpret_cast<const unsigned char *>(m_data);
+    size_t start = i++;
+    while (true) {
+      i += simd::scan_string(m_data + i, m_size - i);
+      if (i == m_size) {
+        break;
+      }
+      auto c = s[i];
+      if (c == '"') {
+        i++;
+        m_tokens.push_back(
+            {token_type::string, start, i - start, m_tokens.size() + 1, 0});
+        return true;
+      }
+      if (c == '\\') {
+        if (++i == m_size) {
+          return false;
+        }
+        c = s[i];
+        if (c == 'u') {
+          if (m_size - i < 5) {
+            return false;
+          }
+          for (size_t j = 1; j <= 4; j++) {
+            if (!is_hex_digit(s[i + j])) {
+              return false;
+            }
+          }
+          i += 4;
+        } else if (c != '"' && c != '\\' && c != '/' && c != 'b' &&
+                   c != 'f' && c != 'n' && c != 'r' && c != 't') {
+          return false;
+        }
+        i++;
+        continue;
+      }
+      auto continuation_bytes = json_utf8_continuation_bytes(c);
+      if (continuation_bytes < 0) {
+        return false;
+      }
+      if (m_size - i <= static_cast<size_t>(continuation_bytes)) {
+        return false;
+      }
+      for (int j = 1; j <= continuation_bytes; j++) {
+        if (s[i + j] < 128 || s[i + j] > 191) {
+          return false;
+        }
+      }
+      i += continuation_bytes + 1;
+    }
+    return false;
+  }
+
+  bool push_literal(size_t &i) {
+    size_t start = i;
+    i += simd::scan_literal(m_data + i, m_size - i);
+    while (i < m_size && !is_delimiter(m_data[i])) {
+      i++;
+    }
+    std::string_view literal{m_data + start, i - start};
+    if (!json_is_literal(literal)) {
+      return false;
+    }
+    m_tokens.push_back(
+        {token_type::literal, start, i - start, m_tokens.size() + 1, 0});
+    return true;
+  }
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  arena_vector<token> m_tokens;
+  arena_vector<size_t> m_stack;
+};
+
+// Random-access view of the elements of an array stored on a tape, such as
+// the params of a binding call. Only valid while the tape is.
+class params_view {
+public:
+  params_view() = default;
+  params_view(const tape &t, size_t array) { reset(t, array); }
+#ifdef WEBVIEW_HAVE_PMR
+  explicit params_view(std::pmr::memory_resource *resource)
+      : m_elements(resource) {}
+#endif
+
+  void reset(const tape &t, size_t array) {
+    m_tape = &t;
+    m_elements.clear();
+    if (array >= t.size() || t[array].type != token_type::array) {
+      return;
+    }
+    m_elements.reserve(t[array].children);
+    for (size_t i = array + 1; i < t[array].next; i = t[i].next) {
+      m_elements.push_back(i);
+    }
+  }
+
+  size_t size() const { return m_elements.size(); }
+  bool empty() const { return m_elements.empty(); }
+
+  // Returns the tape index of the n-th element
+  size_t index(size_t n) const { return m_elements[n]; }
+  const tape &source() const { return *m_tape; }
+
+  token_type type(size_t n) const { return (*m_tape)[m_elements[n]].type; }
+
+  // Returns the raw text of the n-th element, or an empty view if missing
+  std::string_view text(size_t n) const {
+    return n < m_elements.size() ? m_tape->text(m_elements[n])
+                                 : std::string_view{};
+  }
+
+  // Same as json_parse(params, "", n) but without rescanning the params
+  std::string str(size_t n) const {
+    return n < m_elements.size() ? m_tape->str(m_elements[n]) : "";
+  }
+
+  // Same as above, but see tape::str() regarding the buffer
+  template <typename Buffer>
+  std::string_view str(size_t n, Buffer &buffer) const {
+    return n < m_elements.size() ? m_tape->str(m_elements[n], buffer)
+                                 : std::string_view{};
+  }
+
+  // Converts the n-th element without copying it. See tape::number().
+  template <typename T> bool number(size_t n, T &out) const {
+    return n < m_elements.size() && m_tape->number(m_elements[n], out);
+  }
+
+  // Decodes the n-th element, an array of numbers such as [1.5,2,3], into
+  // |out|. See tape::numbers().
+  template <typename T>
+  size_t numbers(size_t n, T *out, size_t capacity) const {
+    return n < m_elements.size()
+               ? m_tape->numbers(m_elements[n], out, capacity)
+               : tape::npos;
+  }
+
+  template <typename T> bool numbers(size_t n, std::vector<T> &out) const {
+    return n < m_elements.size() && m_tape->numbers(m_elements[n], out);
+  }
+
+private:
+  const tape *m_tape = nullptr;
+  arena_vector<size_t> m_elements;
+};
+
+// Converts between values on a tape and C++ types for typed bindings.
+// decode() is given npos for values that are missing altogether and may use
+// |buffer| for data that a decoded view points to. Specialize it to support
+// other types; the buffer and writer are templates since they may allocate
+// from a per-message arena, see basic_writer.
+template <typename T, typename = void> struct value_traits;
+
+template <> struct value_traits<bool> {
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, bool &out, Buffer &) {
+    if (i >= t.size() || t[i].type != token_type::literal) {
+      return false;
+    }
+    auto text = t.text(i);
+    if (text != "true" && text != "false") {
+      return false;
+    }
+    out = text == "true";
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, bool v) { w.value(v); }
+};
+
+template <typename T>
+struct value_traits<
+    T, typename std::enable_if<std::is_integral<T>::value &&
+                               !std::is_same<T, bool>::value &&
+                               !std::is_same<T, char>::value>::type> {
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, T &out, Buffer &) {
+    using limits = std::numeric_limits<T>;
+    int64_t v;
+    if (!t.number(i, v)) {
+      return false;
+    }
+    if (std::is_signed<T>::value
+            ? v < static_cast<int64_t>(limits::min()) ||
+                  v > static_cast<int64_t>(limits::max())
+            : v < 0 || static_cast<uint64_t>(v) >
+                           static_cast<uint64_t>(limits::max())) {
+      return false;
+    }
+    out = static_cast<T>(v);
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, T v) { w.value(v); }
+};
+
+template <typename T>
+struct value_traits<
+    T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, T &out, Buffer &) {
+    double v;
+    if (!t.number(i, v)) {
+      return false;
+    }
+    out = static_cast<T>(v);
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, T v) { w.value(v); }
+};
+
+template <> struct value_traits<std::string_view> {
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, std::string_view &out,
+                     Buffer &buffer) {
+    if (i >= t.size() || t[i].type != token_type::string) {
+      return false;
+    }
+    out = t.str(i, buffer);
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, std::string_view v) { w.value(v); }
+};
+
+// Characters are strings of one byte, the same as the writer writes them
+template <> struct value_traits<char> {
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, char &out, Buffer &buffer) {
+    std::string_view v;
+    if (!value_traits<std::string_view>::decode(t, i, v, buffer) ||
+        v.size() != 1) {
+      return false;
+    }
+    out = v[0];
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, char v) { w.value(v); }
+};
+
+template <> struct value_traits<std::string> {
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, std::string &out,
+                     Buffer &buffer) {
+    std::string_view v;
+    if (!value_traits<std::string_view>::decode(t, i, v, buffer)) {
+      return false;
+    }
+    out.assign(v.data(), v.size());
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, const std::string &v) { w.value(v); }
+};
+
+template <> struct value_traits<const char *> {
+  template <typename Writer>
+  static void encode(Writer &w, const char *v) { w.value(v); }
+};
+
+// Missing values and null decode as std::nullopt
+template <typename T> struct value_traits<std::optional<T>> {
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, std::optional<T> &out,
+                     Buffer &buffer) {
+    if (i >= t.size() || t.text(i) == "null") {
+      out.reset();
+      return true;
+    }
+    out.emplace();
+    return value_traits<T>::decode(t, i, *out, buffer);
+  }
+  template <typename Writer>
+  static void encode(Writer &w, const std::optional<T> &v) {
+    if (v) {
+      value_traits<T>::encode(w, *v);
+    } else {
+      w.value(nullptr);
+    }
+  }
+};
+
+template <typename T> struct value_traits<std::vector<T>> {
+  static_assert(!std::is_same<T, std::string_view>::value,
+                "Views can't be decoded into containers, use std::string");
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, std::vector<T> &out,
+                     Buffer &buffer) {
+    if constexpr (std::is_same<T, double>::value ||
+                  std::is_same<T, int64_t>::value) {
+      return t.numbers(i, out);
+    }
+    if (i >= t.size() || t[i].type != token_type::array) {
+      return false;
+    }
+    out.clear();
+    out.reserve(t[i].children);
+    for (size_t j = i + 1; j < t[i].next; j = t[j].next) {
+      T element{};
+      if (!value_traits<T>::decode(t, j, element, buffer)) {
+        return false;
+      }
+      out.push_back(std::move(element));
+    }
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, const std::vector<T> &v) {
+    w.begin_array();
+    for (const auto &element : v) {
+      value_traits<T>::encode(w, element);
+    }
+    w.end_array();
+  }
+};
+
+template <typename T> struct value_traits<std::map<std::string, T>> {
+  static_assert(!std::is_same<T, std::string_view>::value,
+                "Views can't be decoded into containers, use std::string");
+  template <typename Buffer>
+  static bool decode(const tape &t, size_t i, std::map<std::string, T> &out,
+                     Buffer &buffer) {
+    if (i >= t.size() || t[i].type != token_type::object) {
+      return false;
+    }
+    out.clear();
+    for (size_t j = i + 1; j < t[i].next; j = t[j + 1].next) {
+      if (!value_traits<T>::decode(t, j + 1, out[t.str(j)], buffer)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  template <typename Writer>
+  static void encode(Writer &w, const std::map<std::string, T> &v) {
+    w.begin_object();
+    for (const auto &member : v) {
+      w.key(member.first);
+      value_traits<T>::encode(w, member.second);
+    }
+    w.end_object();
+  }
+};
+
+// Reads a call that arrives in chunks of any size, either as an envelope
+// such as {"id":1,"method":"foo","params":[...]} or as [method id,seq,
+// [params]]. The elements of the latter are reported as the members
+// method, id and params. Members and the elements of params are reported
+// as soon as they are complete, so that only the value currently being
+// read has to be buffered. Strings are validated like by the tape.
+class incremental_reader {
+public:
+  // Called with the raw JSON text of members other than params, e.g. id
+  std::function<void(std::string_view key, std::string_view value)> on_member;
+  // Called with the JSON text of each element of params
+  std::function<void(size_t index, std::string_view value)> on_param;
+  // If set, string params are decoded as they are read. Strings that
+  // decode to spill_threshold bytes or more are passed here in pieces
+  // instead of to on_param, with the last piece marked as such. Shorter
+  // ones are escaped again for on_param.
+  std::function<void(size_t index, std::string_view chunk, bool last)>
+      on_spill;
+  size_t spill_threshold = 64 * 1024;
+
+  // Consumes the next chunk of the message. Returns false once the message
+  // turns out to be invalid, after which the reader must be reset.
+  bool feed(const char *s, size_t n) {
+    if (m_state == state::failed) {
+      return false;
+    }
+    m_capture_from = 0;
+    m_literal_from = 0;
+    for (size_t i = 0; i < n;) {
+      if (!step(s, n, i)) {
+        m_state = state::failed;
+        return false;
+      }
+    }
+    if (m_capturing) {
+      m_value.append(s + m_capture_from, n - m_capture_from);
+    }
+    if (m_state == state::literal) {
+      m_literal.append(s + m_literal_from, n - m_literal_from);
+    }
+    return true;
+  }
+
+  bool feed(std::string_view s) { return feed(s.data(), s.size()); }
+
+  // Returns whether a complete message has been read
+  bool done() const { return m_state == state::done; }
+
+  // Prepares the reader for the next message, keeping the callbacks
+  void reset() {
+    m_state = state::value;
+    m_stack.clear();
+    m_key.clear();
+    m_value.clear();
+    m_decoded.clear();
+    m_param_index = 0;
+    m_member_index = 0;
+    m_high_surrogate = 0;
+    m_capturing = false;
+    m_decoding = false;
+    m_spilled = false;
+    m_in_params = false;
+  }
+
+private:
+  enum class state : unsigned char {
+    value,
+    value_or_end,
+    key,
+    key_or_end,
+    colon,
+    comma_or_end,
+    string,
+    escape,
+    unicode,
+    literal,
+    done,
+    failed
+  };
+
+  static bool is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  }
+
+  // Processes one or more bytes starting at |i|
+  bool step(const char *s, size_t n, size_t &i) {
+    auto c = s[i];
+    switch (m_state) {
+    case state::value:
+    case state::value_or_end:
+      if (is_whitespace(c)) {
+        break;
+      }
+      if (c == ']' && m_state == state::value_or_end) {
+        return close(s, i, '[');
+      }
+      begin_value(s, i);
+      if (c == '{' || c == '[') {
+        m_stack.push_back(c);
+        m_state = c == '{' ? state::key_or_end : state::value_or_end;
+      } else if (c == '"') {
+        m_string_is_key = false;
+        m_utf8_remaining = 0;
+        m_state = state::string;
+      } else {
+        m_literal.clear();
+        m_literal_from = i;
+        m_state = state::literal;
+      }
+      break;
+    case state::key:
+    case state::key_or_end:
+      if (is_whitespace(c)) {
+        break;
+      }
+      if (c == '}' && m_state == state::key_or_end) {
+        return close(s, i, '{');
+      }
+      if (c != '"') {
+        return false;
+      }
+      m_string_is_key = true;
+      m_utf8_remaining = 0;
+      if (m_stack.size() == 1) {
+        m_key.clear();
+      }
+      m_state = state::string;
+      break;
+    case state::colon:
+      if (is_whitespace(c)) {
+        break;
+      }
+      if (c != ':') {
+        return false;
+      }
+      m_state = state::value;
+      break;
+    case state::comma_or_end:
+      if (is_whitespace(c)) {
+        break;
+      }
+      if (c == ',') {
+        m_state = m_stack.back() == '{' ? state::key : state::value;
+        break;
+      }
+      if (c == '}' || c == ']') {
+        return close(s, i, c == '}' ? '{' : '[');
+      }
+      return false;
+    case state::string:
+      return step_string(s, n, i);
+    case state::escape:
+      return step_escape(s, i);
+    case state::unicode:
+      return step_unicode(s, i);
+    case state::literal:
+      if (c != ',' && c != ']' && c != '}' && c != ':' && !is_whitespace(c)) {
+        break;
+      }
+      // The delimiter is processed again once the literal has been checked
+      m_literal.append(s + m_literal_from, i - m_literal_from);
+      if (!json_is_literal(m_literal)) {
+        return false;
+      }
+      end_value(s, i);
+      return true;
+    case state::done:
+      if (!is_whitespace(c)) {
+        return false;
+      }
+      break;
+    case state::failed:
+      return false;
+    }
+    i++;
+    return true;
+  }
+
+  bool step_string(const char *s, size_t n, size_t &i) {
+    auto run = m_utf8_remaining == 0 ? simd::scan_string(s + i, n - i) : 0;
+    if (run > 0) {
+      append_text(s + i, run);
+      i += run;
+      return true;
+    }
+    auto c = static_cast<unsigned char>(s[i]);
+    if (m_utf8_remaining > 0) {
+      if (c < 128 || c > 191) {
+        return false;
+      }
+      m_utf8_remaining--;
+    } else if (c == '"') {
+      flush_surrogate();
+      if (m_string_is_key) {
+        m_state = state::colon;
+      } else {
+        end_value(s, i + 1);
+      }
+      i++;
+      return true;
+    } else if (c == '\\') {
+      m_state = state::escape;
+      i++;
+      return true;
+    } else {
+      m_utf8_remaining = json_utf8_continuation_bytes(c);
+      if (m_utf8_remaining < 0) {
+        return false;
+      }
+    }
+    append_text(s + i, 1);
+    i++;
+    return true;
+  }
+
+  bool step_escape(const char *s, size_t &i) {
+    char c;
+    switch (s[i]) {
+    case 'b':
+      c = '\b';
+      break;
+    case 'f':
+      c = '\f';
+      break;
+    case 'n':
+      c = '\n';
+      break;
+    case 'r':
+      c = '\r';
+      break;
+    case 't':
+      c = '\t';
+      break;
+    case '\\':
+    case '/':
+    case '"':
+      c = s[i];
+      break;
+    case 'u':
+      if (m_string_is_key) {
+        append_text("\\u", 2);
+      }
+      m_code_unit = 0;
+      m_hex_digits = 0;
+      m_state = state::unicode;
+      i++;
+      return true;
+    default:
+      return false;
+    }
+    if (m_string_is_key) {
+      // Keys of the envelope are matched verbatim
+      append_text("\\", 1);
+      append_text(s + i, 1);
+    } else if (m_decoding) {
+      flush_surrogate();
+      append_decoded(&c, 1);
+    }
+    m_state = state::string;
+    i++;
+    return true;
+  }
+
+  bool step_unicode(const char *s, size_t &i) {
+    auto c = s[i];
+    unsigned int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    m_code_unit = (m_code_unit << 4) | digit;
+    i++;
+    if (m_string_is_key) {
+      append_text(&c, 1);
+    }
+    if (++m_hex_digits < 4) {
+      return true;
+    }
+    m_state = state::string;
+    if (!m_decoding || m_string_is_key) {
+      return true;
+    }
+    auto unit = m_code_unit;
+    if (m_high_surrogate != 0 && unit >= 0xdc00 && unit <= 0xdfff) {
+      unit = 0x10000 + ((m_high_surrogate - 0xd800) << 10) + (unit - 0xdc00);
+      m_high_surrogate = 0;
+    } else {
+      flush_surrogate();
+      if (unit >= 0xd800 && unit <= 0xdbff) {
+        m_high_surrogate = unit;
+        return true;
+      }
+      if (unit >= 0xdc00 && unit <= 0xdfff) {
+        unit = 0xfffd;
+      }
+    }
+    char utf8[4];
+    append_decoded(utf8, json_encode_utf8(unit, utf8));
+    return true;
+  }
+
+  // Lone high surrogates are replaced, the same as in json_unescape()
+  void flush_surrogate() {
+    if (m_high_surrogate != 0) {
+      m_high_surrogate = 0;
+      char utf8[4];
+      append_decoded(utf8, json_encode_utf8(0xfffd, utf8));
+    }
+  }
+
+  void append_text(const char *s, size_t n) {
+    if (m_string_is_key) {
+      if (m_stack.size() == 1) {
+        m_key.append(s, n);
+      }
+    } else if (m_decoding) {
+      flush_surrogate();
+      append_decoded(s, n);
+    }
+  }
+
+  void append_decoded(const char *s, size_t n) {
+    m_decoded.append(s, n);
+    if (m_decoded.size() < spill_threshold) {
+      return;
+    }
+    m_spilled = true;
+    on_spill(m_param_index, m_decoded, false);
+    m_decoded.clear();
+  }
+
+  void begin_value(const char *s, size_t i) {
+    auto depth = m_stack.size();
+    if (depth == 1 && m_stack[0] == '[') {
+      static constexpr const char *members[] = {"method", "id", "params"};
+      m_key = m_member_index < 3 ? members[m_member_index] : "";
+      m_member_index++;
+    }
+    if (depth == 1 && m_key == "params" && s[i] == '[') {
+      m_in_params = true;
+      return;
+    }
+    if (depth == 1 || (depth == 2 && m_in_params)) {
+      // Strings that are decoded aren't kept as they are as well
+      m_decoding = depth == 2 && s[i] == '"' && on_spill;
+      m_capturing = !m_decoding;
+      m_capture_depth = depth;
+      m_capture_from = i;
+      m_value.clear();
+      m_spilled = false;
+      m_decoded.clear();
+      m_high_surrogate = 0;
+    }
+  }
+
+  bool close(const char *s, size_t &i, char open) {
+    if (m_stack.empty() || m_stack.back() != open) {
+      return false;
+    }
+    m_stack.pop_back();
+    if (m_stack.size() == 1 && m_in_params && open == '[') {
+      m_in_params = false;
+      m_state = state::comma_or_end;
+    } else {
+      end_value(s, i + 1);
+    }
+    i++;
+    return true;
+  }
+
+  // Completes the value that ends right before |end|
+  void end_value(const char *s, size_t end) {
+    if ((m_capturing || m_decoding) && m_stack.size() == m_capture_depth) {
+      if (m_capturing) {
+        m_value.append(s + m_capture_from, end - m_capture_from);
+        m_capturing = false;
+      }
+      if (m_capture_depth == 1) {
+        if (on_member) {
+          on_member(m_key, m_value);
+        }
+      } else if (m_spilled) {
+        on_spill(m_param_index, m_decoded, true);
+      } else {
+        if (m_decoding) {
+          json_escape(m_decoded, m_value);
+        }
+        if (on_param) {
+          on_param(m_param_index, m_value);
+        }
+      }
+      if (m_capture_depth == 2) {
+        m_param_index++;
+      }
+      m_decoding = false;
+      m_spilled = false;
+    }
+    m_state = m_stack.empty() ? state::done : state::comma_or_end;
+  }
+
+  state m_state = state::value;
+  std::vector<char> m_stack;
+  std::string m_key;
+  std::string m_value;
+  std::string m_literal;
+  std::string m_decoded;
+  size_t m_capture_from = 0;
+  size_t m_capture_depth = 0;
+  size_t m_literal_from = 0;
+  size_t m_param_index = 0;
+  size_t m_member_index = 0;
+  unsigned int m_code_unit = 0;
+  unsigned int m_high_surrogate = 0;
+  int m_hex_digits = 0;
+  int m_utf8_remaining = 0;
+  bool m_string_is_key = false;
+  bool m_capturing = false;
+  bool m_decoding = false;
+  bool m_spilled = false;
+  bool m_in_params = false;
+};
+
 } // namespace json
 } // namespace webview
\ No newline at end of file
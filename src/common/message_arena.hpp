@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "json_utils.hpp"
+
+namespace webview {
+namespace detail {
+
+#ifdef WEBVIEW_HAVE_PMR
+using arena_string = std::pmr::string;
+
+// Memory for everything that is only needed while a message is handled.
+// Allocations are served from an inline buffer first and freed all at once
+// by reset(), so that handling a message doesn't use the global heap for
+// typical messages.
+class message_arena {
+public:
+  message_arena() : m_resource(m_initial, sizeof(m_initial)) {}
+
+  message_arena(const message_arena &other) = delete;
+  message_arena &operator=(const message_arena &other) = delete;
+
+  std::pmr::memory_resource *resource() { return &m_resource; }
+
+  // Frees all allocations. Nothing allocated from the arena may be used
+  // afterwards.
+  void reset() { m_resource.release(); }
+
+  // Returns the arena of the message that the current thread is handling,
+  // or nullptr
+  static message_arena *current() { return t_current; }
+
+private:
+  friend class arena_pool;
+
+  alignas(std::max_align_t) char m_initial[16 * 1024];
+  std::pmr::monotonic_buffer_resource m_resource;
+
+  static inline thread_local message_arena *t_current = nullptr;
+};
+
+// Keeps a few arenas around for reuse, since the threads that handle
+// messages at the same time need one each. Can be used from any thread.
+class arena_pool {
+public:
+  // Makes an arena the current one of the thread for as long as it exists,
+  // and then resets it and gives it back to the pool
+  class lease {
+  public:
+    explicit lease(arena_pool &pool)
+        : m_pool(pool), m_arena(pool.take()),
+          m_previous(message_arena::t_current) {
+      message_arena::t_current = m_arena.get();
+    }
+
+    ~lease() {
+      message_arena::t_current = m_previous;
+      m_arena->reset();
+      m_pool.give_back(std::move(m_arena));
+    }
+
+    lease(const lease &other) = delete;
+    lease &operator=(const lease &other) = delete;
+
+    std::pmr::memory_resource *resource() { return m_arena->resource(); }
+
+  private:
+    arena_pool &m_pool;
+    std::unique_ptr<message_arena> m_arena;
+    message_arena *m_previous;
+  };
+
+private:
+  // Arenas beyond this are freed when they are given back
+  static constexpr size_t max_idle = 8;
+
+  std::unique_ptr<message_arena> take() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_idle.empty()) {
+        auto arena = std::move(m_idle.back());
+        m_idle.pop_back();
+        return arena;
+      }
+    }
+    return std::make_unique<message_arena>();
+  }
+
+  void give_back(std::unique_ptr<message_arena> arena) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle.size() < max_idle) {
+      m_idle.push_back(std::move(arena));
+    }
+  }
+
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<message_arena>> m_idle;
+};
+
+// Returns an allocator for the arena of the current message, or for the
+// global heap outside of messages
+inline arena_string::allocator_type arena_allocator() {
+  auto arena = message_arena::current();
+  return arena ? arena->resource() : std::pmr::get_default_resource();
+}
+#else
+using arena_string = std::string;
+
+// Without polymorphic allocators messages are always handled on the heap
+class arena_pool {};
+
+inline arena_string::allocator_type arena_allocator() { return {}; }
+#endif
+
+} // namespace detail
+} // namespace webview
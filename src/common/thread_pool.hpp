@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace webview {
+namespace detail {
+
+// A fixed set of worker threads with a queue each. Workers take their own
+// newest tasks first and steal the oldest tasks of other workers when they
+// run out. The pool runs the tasks that are still queued when it is
+// destroyed before its workers exit.
+class thread_pool {
+public:
+  using task_t = std::function<void()>;
+
+  // Starts |threads| workers, or one per core if |threads| is 0
+  explicit thread_pool(size_t threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; i++) {
+      m_queues.emplace_back(new worker_queue);
+    }
+    for (size_t i = 0; i < threads; i++) {
+      m_threads.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for (auto &thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  thread_pool(const thread_pool &other) = delete;
+  thread_pool &operator=(const thread_pool &other) = delete;
+
+  size_t size() const { return m_threads.size(); }
+
+  // Can be called from any thread. Tasks submitted by a worker go to its own
+  // queue, others are spread over all queues.
+  void submit(task_t task) {
+    size_t index = t_pool == this
+                       ? t_index
+                       : m_next_queue.fetch_add(1, std::memory_order_relaxed) %
+                             m_queues.size();
+    {
+      auto &queue = *m_queues[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ++m_pending;
+    }
+    m_wakeup.notify_one();
+  }
+
+private:
+  struct worker_queue {
+    std::mutex mutex;
+    std::deque<task_t> tasks;
+  };
+
+  void work(size_t self) {
+    t_pool = this;
+    t_index = self;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wakeup.wait(lock, [this] { return m_stopping || m_pending > 0; });
+        if (m_pending == 0) {
+          return;
+        }
+        --m_pending;
+      }
+      // Every task is counted after it has been queued, so the task that was
+      // claimed above is in one of the queues.
+      task_t task;
+      while (!take(self, task)) {
+        std::this_thread::yield();
+      }
+      task();
+    }
+  }
+
+  bool take(size_t self, task_t &task) {
+    {
+      auto &own = *m_queues[self];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < m_queues.size(); i++) {
+      auto &victim = *m_queues[(self + i) % m_queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::unique_ptr<worker_queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::atomic<size_t> m_next_queue{0};
+  // Queued tasks that no worker has claimed yet
+  std::mutex m_mutex;
+  std::condition_variable m_wakeup;
+  size_t m_pending = 0;
+  bool m_stopping = false;
+
+  // The pool and queue of the current worker thread
+  static inline thread_local thread_pool *t_pool = nullptr;
+  static inline thread_local size_t t_index = 0;
+};
+
+} // namespace detail
+} // namespace webview
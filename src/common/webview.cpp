@@ -1,14 +1,298 @@
+#include <algorithm>
+#include <charconv>
+#include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "webview.hpp"
 #include "json_utils.hpp"
 
 namespace webview {
 
-webview::webview(bool debug, void *wnd) : browser_engine(debug, wnd) {}
+// Owns the calls that are waiting for results and posts calls to the
+// native side. Bindings register their functions with bind().
+static const char *const rpc_runtime = R""((function() {
+  if (window.__webview__) {
+    return;
+  }
+  var pending = new Map();
+  var nextSeq = 1;
+  var queue = [];
+  // Calls longer than this are posted in pieces, so that the native side
+  // can read them without holding all of them at once
+  var PIECE_SIZE = 1 << 20;
+  // Calls made in the same task are posted together once it is done.
+  // They are serialized right away in case the arguments change.
+  function post(call) {
+    if (queue.push(JSON.stringify(call)) > 1) {
+      return;
+    }
+    Promise.resolve().then(function() {
+      var calls = queue;
+      var batch = [];
+      queue = [];
+      calls.forEach(function(text) {
+        if (text.length <= PIECE_SIZE) {
+          batch.push(text);
+          return;
+        }
+        send(batch);
+        batch = [];
+        sendPieces(text);
+      });
+      send(batch);
+    });
+  }
+  function send(calls) {
+    if (calls.length > 0) {
+      window.external.invoke(
+          calls.length == 1 ? calls[0] : '[' + calls.join(',') + ']');
+    }
+  }
+  // Pieces start with '+', and the last one with '.'. They don't end
+  // between the halves of a surrogate pair.
+  function sendPieces(text) {
+    for (var i = 0; i < text.length;) {
+      var end = Math.min(i + PIECE_SIZE, text.length);
+      var code = text.charCodeAt(end - 1);
+      if (end < text.length && code >= 0xd800 && code <= 0xdbff) {
+        end--;
+      }
+      window.external.invoke((end < text.length ? '+' : '.') +
+                             text.slice(i, end));
+      i = end;
+    }
+  }
+  // Removes a call that is no longer waited for along with its timer and
+  // abort listener
+  function take(seq) {
+    var entry = pending.get(seq);
+    if (entry) {
+      pending.delete(seq);
+      clearTimeout(entry.timer);
+      if (entry.signal) {
+        entry.signal.removeEventListener('abort', entry.abort);
+      }
+    }
+    return entry;
+  }
+  // Tells the native side that the result of a call isn't needed anymore
+  function abandon(seq) {
+    var entry = take(seq);
+    if (entry) {
+      post([CANCEL, seq]);
+    }
+    return entry;
+  }
+  // Rejects a call that timed out or was aborted
+  function cancel(seq, reason) {
+    var entry = abandon(seq);
+    if (entry) {
+      entry.reject(reason);
+    }
+  }
+  var CANCEL = -1;
+  // Posts a call that settles the given entry. Options are the timeout in
+  // milliseconds, if any, and an AbortSignal. Returns the sequence number,
+  // or 0 if the signal was aborted already.
+  function start(id, args, options, entry) {
+    var signal = options.signal;
+    if (signal && signal.aborted) {
+      entry.reject(signal.reason);
+      return 0;
+    }
+    var seq = nextSeq++;
+    if (options.timeout > 0) {
+      entry.timer = setTimeout(function() {
+        cancel(seq, new DOMException('Timed out after ' + options.timeout +
+                                     ' ms', 'TimeoutError'));
+      }, options.timeout);
+    }
+    if (signal) {
+      entry.signal = signal;
+      entry.abort = function() {
+        cancel(seq, signal.reason);
+      };
+      signal.addEventListener('abort', entry.abort);
+    }
+    pending.set(seq, entry);
+    post([id, seq, Array.prototype.slice.call(args)]);
+    return seq;
+  }
+  function call(id, args, options) {
+    return new Promise(function(resolve, reject) {
+      start(id, args, options, {resolve: resolve, reject: reject});
+    });
+  }
+  // Returns an async iterator over the chunks of a streaming call. The
+  // iterator ends when the call is resolved and throws if it is rejected.
+  function stream(id, args, options) {
+    var chunks = [];
+    var waiting = [];
+    var end = null;
+    function deliver() {
+      while (waiting.length > 0 && (chunks.length > 0 || end)) {
+        var next = waiting.shift();
+        if (chunks.length > 0) {
+          next.resolve({value: chunks.shift(), done: false});
+        } else if (end.ok) {
+          next.resolve({value: undefined, done: true});
+        } else {
+          next.reject(end.error);
+          end = {ok: true};
+        }
+      }
+    }
+    var seq = start(id, args, options, {
+      chunk: function(value) {
+        chunks.push(value);
+        deliver();
+      },
+      resolve: function() {
+        end = {ok: true};
+        deliver();
+      },
+      reject: function(error) {
+        end = {ok: false, error: error};
+        deliver();
+      },
+    });
+    var iterator = {
+      next: function() {
+        return new Promise(function(resolve, reject) {
+          waiting.push({resolve: resolve, reject: reject});
+          deliver();
+        });
+      },
+      // Called when a for await loop is left early
+      return: function() {
+        abandon(seq);
+        chunks = [];
+        end = {ok: true};
+        deliver();
+        return Promise.resolve({value: undefined, done: true});
+      },
+    };
+    iterator[Symbol.asyncIterator] = function() {
+      return iterator;
+    };
+    return iterator;
+  }
+  // Events that the native side emits, with the payload as the detail
+  var events = new EventTarget();
+  window.__webview__ = {
+    addEventListener: events.addEventListener.bind(events),
+    removeEventListener: events.removeEventListener.bind(events),
+    emit: function(type, payload) {
+      events.dispatchEvent(new CustomEvent(type, {detail: payload}));
+    },
+    // Takes an object that maps names to binding ids, or to an array of the
+    // id, the timeout and whether the binding streams its results
+    bind: function(ids) {
+      Object.keys(ids).forEach(function(name) {
+        var id = ids[name];
+        var timeout = 0;
+        var invoke = call;
+        if (Array.isArray(id)) {
+          timeout = id[1];
+          invoke = id[2] ? stream : call;
+          id = id[0];
+        }
+        var binding = function() {
+          return invoke(id, arguments, {timeout: timeout});
+        };
+        // Returns the binding with options for the calls made through it,
+        // e.g. window.compute.with({signal: controller.signal})(6, 7)
+        binding.with = function(options) {
+          options = Object.assign({timeout: timeout}, options);
+          return function() {
+            return invoke(id, arguments, options);
+          };
+        };
+        window[name] = binding;
+      });
+    },
+    unbind: function(name) {
+      delete window[name];
+    },
+    settle: function(seq, ok, value) {
+      var entry = take(seq);
+      if (entry) {
+        (ok ? entry.resolve : entry.reject)(value);
+      }
+    },
+    chunk: function(seq, value) {
+      var entry = pending.get(seq);
+      if (entry && entry.chunk) {
+        entry.chunk(value);
+      }
+    },
+  };
+})())"";
+
+// Results are delivered together by one script, so a result that isn't
+// valid JSON would keep the others from being delivered. An empty result
+// stands for undefined.
+static bool is_valid_result(std::string_view result) {
+  if (result.empty()) {
+    return true;
+  }
+  thread_local json::tape tape;
+  return tape.parse(result);
+}
+
+// The runtime numbers its calls, and other sequence numbers can't be
+// passed to it
+static bool is_valid_seq(std::string_view seq) {
+  return !seq.empty() && seq.size() < 20 &&
+         std::all_of(seq.begin(), seq.end(),
+                     [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// Only for sequence numbers that passed is_valid_seq()
+static uint64_t seq_number(std::string_view seq) {
+  return json::json_parse_digits(seq.data(), seq.size());
+}
+
+static const std::string invalid_result =
+    json::json_escape("The result is not valid JSON");
+
+webview::webview(bool debug, void *wnd) : browser_engine(debug, wnd) {
+  m_piece_reader.on_member = [this](std::string_view key,
+                                    std::string_view value) {
+    if (key == "method") {
+      m_piece_method = value;
+    } else if (key == "id") {
+      m_piece_seq = value;
+    }
+  };
+  m_piece_reader.on_param = [this](size_t index, std::string_view value) {
+    m_piece_params += index == 0 ? '[' : ',';
+    m_piece_params += value;
+  };
+  init(rpc_runtime);
+  eval(rpc_runtime);
+}
+
+webview::~webview() {
+  // Pool tasks that are still running may be waiting for room in a queue
+  m_closing = true;
+  {
+    std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+  }
+  m_dispatch_space.notify_all();
+  {
+    std::lock_guard<std::mutex> lock(m_resolve_mutex);
+  }
+  m_resolve_space.notify_all();
+}
 
 void webview::navigate(const std::string &url) {
+  flush_bindings();
   if (url.empty()) {
     browser_engine::navigate("about:blank");
     return;
@@ -16,76 +300,822 @@ void webview::navigate(const std::string &url) {
   browser_engine::navigate(url);
 }
 
+void webview::set_html(std::string_view html) {
+  flush_bindings();
+  browser_engine::set_html(html);
+}
+
+bool webview::dispatch(std::function<void()> f, dispatch_policy policy) {
+  std::function<void()> dropped;
+  bool schedule;
+  {
+    std::unique_lock<std::mutex> lock(m_dispatch_mutex);
+    auto full = [this] {
+      auto capacity = m_dispatch_capacity.load();
+      return capacity > 0 && m_dispatch_queue.size() >= capacity && !m_closing;
+    };
+    if (full()) {
+      switch (policy) {
+      case dispatch_policy::block:
+        if (std::this_thread::get_id() != m_main_thread) {
+          m_dispatch_space.wait(lock, [&] { return !full(); });
+        }
+        break;
+      case dispatch_policy::try_push:
+        return false;
+      case dispatch_policy::drop_oldest:
+        // Destroyed once the lock is released
+        dropped = std::move(m_dispatch_queue.front());
+        m_dispatch_queue.pop_front();
+        break;
+      }
+    }
+    m_dispatch_queue.push_back(std::move(f));
+    schedule = !m_drain_scheduled;
+    m_drain_scheduled = true;
+  }
+  // The engine is asked to run the queue once instead of for every function
+  if (schedule) {
+    browser_engine::dispatch([this] { drain_dispatch_queue(); });
+  }
+  return true;
+}
+
+void webview::set_dispatch_capacity(size_t capacity) {
+  {
+    std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+    m_dispatch_capacity = capacity;
+  }
+  m_dispatch_space.notify_all();
+  {
+    std::lock_guard<std::mutex> lock(m_resolve_mutex);
+  }
+  m_resolve_space.notify_all();
+}
+
+size_t webview::dispatch_queue_depth() const {
+  size_t depth;
+  {
+    std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+    depth = m_dispatch_queue.size();
+  }
+  std::lock_guard<std::mutex> lock(m_resolve_mutex);
+  return depth + m_pending_count;
+}
+
+void webview::drain_dispatch_queue() {
+  // Functions queued while this runs wait for the next turn of the main
+  // loop so that they can't starve it
+  size_t count;
+  {
+    std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+    count = m_dispatch_queue.size();
+  }
+  for (size_t i = 0; i < count; i++) {
+    std::function<void()> f;
+    {
+      std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+      if (m_dispatch_queue.empty()) {
+        break;
+      }
+      f = std::move(m_dispatch_queue.front());
+      m_dispatch_queue.pop_front();
+    }
+    m_dispatch_space.notify_one();
+    f();
+  }
+  bool again;
+  {
+    std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+    again = !m_dispatch_queue.empty();
+    m_drain_scheduled = again;
+  }
+  if (again) {
+    browser_engine::dispatch([this] { drain_dispatch_queue(); });
+  }
+}
+
 webview::binding_ctx_t::binding_ctx_t(binding_t callback, void *arg)
     : callback(callback), arg(arg) {}
 
+webview::binding_ctx_t::binding_ctx_t(params_binding_t callback, void *arg)
+    : params_callback(callback), arg(arg) {}
+
+webview::binding_ctx_t::binding_ctx_t(view_binding_t callback, void *arg)
+    : view_callback(callback), arg(arg) {}
+
 // Synchronous bind
-void webview::bind(const std::string &name, sync_binding_t fn) {
+void webview::bind(const std::string &name, sync_binding_t fn,
+                   binding_thread thread) {
   auto wrapper = [this, fn](const std::string &seq, const std::string &req,
                             void * /*arg*/) { resolve(seq, 0, fn(req)); };
-  bind(name, wrapper, nullptr);
+  bind(name, wrapper, nullptr, thread);
 }
 
 // Asynchronous bind
-void webview::bind(const std::string &name, binding_t fn, void *arg) {
+void webview::bind(const std::string &name, binding_t fn, void *arg,
+                   binding_thread thread) {
+  binding_ctx_t ctx(fn, arg);
+  ctx.thread = thread;
+  bind(name, std::move(ctx));
+}
+
+// Asynchronous bind with parsed params
+void webview::bind(const std::string &name, params_binding_t fn, void *arg,
+                   binding_thread thread) {
+  binding_ctx_t ctx(fn, arg);
+  ctx.thread = thread;
+  bind(name, std::move(ctx));
+}
+
+// Asynchronous bind with slices of the message
+void webview::bind_view(const std::string &name, view_binding_t fn, void *arg,
+                        binding_thread thread) {
+  binding_ctx_t ctx(fn, arg);
+  ctx.thread = thread;
+  bind(name, std::move(ctx));
+}
+
+// Streaming bind
+void webview::bind_stream(const std::string &name, binding_t fn, void *arg,
+                          binding_thread thread) {
+  binding_ctx_t ctx(fn, arg);
+  ctx.thread = thread;
+  ctx.streaming = true;
+  ctx.deferred = true;
+  bind(name, std::move(ctx));
+}
+
+// Streaming bind with parsed params
+void webview::bind_stream(const std::string &name, params_binding_t fn,
+                          void *arg, binding_thread thread) {
+  binding_ctx_t ctx(fn, arg);
+  ctx.thread = thread;
+  ctx.streaming = true;
+  ctx.deferred = true;
+  bind(name, std::move(ctx));
+}
+
+// Polled bind
+void webview::bind_polled(const std::string &name) {
+  binding_ctx_t ctx(
+      view_binding_t(
+          [this, name](std::string_view seq, std::string_view req, void *) {
+            if (!m_polled_calls.push(name, seq, req)) {
+              resolve(seq, 1, json::json_escape("Too many pending calls"));
+            }
+          }),
+      nullptr);
+  // The host completes the calls after it polled for them
+  ctx.deferred = true;
+  bind(name, std::move(ctx));
+}
+
+bool webview::set_poll_capacity(size_t calls) {
+  return m_polled_calls.set_capacity(calls);
+}
+
+size_t webview::poll_calls(polled_call *out, size_t max) {
+  return poll_calls(max, [&out](const polled_call &call) { *out++ = call; });
+}
+
+void webview::bind(const std::string &name, binding_ctx_t ctx) {
   if (bindings.count(name) > 0) {
     return;
   }
-  bindings.emplace(name, binding_ctx_t(fn, arg));
-  auto js = "(function() { var name = '" + name + "';" + R""(
-      var RPC = window._rpc = (window._rpc || {nextSeq: 1});
-      window[name] = function() {
-        var seq = RPC.nextSeq++;
-        var promise = new Promise(function(resolve, reject) {
-          RPC[seq] = {
-            resolve: resolve,
-            reject: reject,
-          };
-        });
-        window.external.invoke(JSON.stringify({
-          id: seq,
-          method: name,
-          params: Array.prototype.slice.call(arguments),
-        }));
-        return promise;
-      }
-    })())"";
-  init(js);
-  eval(js);
+  uint32_t slot;
+  if (m_free_binding_ids.empty()) {
+    slot = static_cast<uint32_t>(m_binding_ids.size());
+    m_binding_ids.push_back({nullptr, 0});
+  } else {
+    slot = m_free_binding_ids.back();
+    m_free_binding_ids.pop_back();
+  }
+  auto &entry = m_binding_ids[slot];
+  ctx.id = static_cast<uint64_t>(entry.generation) << 32 | slot;
+  auto &context = bindings.emplace(name, std::move(ctx)).first->second;
+  entry.context = &context;
+  queue_binding(name, context);
+}
+
+const webview::binding_ctx_t *webview::find_binding(uint64_t id) const {
+  auto slot = id & 0xffffffff;
+  if (slot >= m_binding_ids.size() ||
+      m_binding_ids[slot].generation != id >> 32) {
+    return nullptr;
+  }
+  return m_binding_ids[slot].context;
+}
+
+void webview::queue_binding(const std::string &name,
+                            const binding_ctx_t &context) {
+  // Bindings are registered together before the next page loads, or on
+  // the current page once the main loop gets to it
+  m_pending_bindings += m_pending_bindings.empty() ? "{" : ",";
+  append_binding(m_pending_bindings, name, context);
+  if (!m_bindings_scheduled) {
+    m_bindings_scheduled = true;
+    browser_engine::dispatch([this] { flush_bindings(); });
+  }
+}
+
+void webview::append_binding(std::string &table, const std::string &name,
+                             const binding_ctx_t &context) {
+  table += json::json_escape(name);
+  table += ':';
+  if (context.timeout_ms == 0 && !context.streaming) {
+    table += std::to_string(context.id);
+    return;
+  }
+  table += '[';
+  table += std::to_string(context.id);
+  table += ',';
+  table += std::to_string(context.timeout_ms);
+  table += context.streaming ? ",1]" : "]";
+}
+
+void webview::flush_bindings() {
+  m_bindings_scheduled = false;
+  if (m_pending_bindings.empty()) {
+    return;
+  }
+  eval("window.__webview__.bind(" + m_pending_bindings + "})");
+  m_pending_bindings.clear();
+  update_bindings_script();
+}
+
+void webview::update_bindings_script() {
+  // Pages that load later get all the bindings from a single script, which
+  // is replaced whenever they change
+  if (bindings.empty()) {
+    if (m_bindings_script) {
+      remove_user_script(m_bindings_script);
+      m_bindings_script = 0;
+    }
+    return;
+  }
+  std::string js = "window.__webview__.bind({";
+  for (const auto &binding : bindings) {
+    if (js.back() != '{') {
+      js += ',';
+    }
+    append_binding(js, binding.first, binding.second);
+  }
+  js += "})";
+  if (m_bindings_script) {
+    replace_user_script(m_bindings_script, js);
+  } else {
+    m_bindings_script = add_user_script(js);
+  }
 }
 
 void webview::unbind(const std::string &name) {
   auto found = bindings.find(name);
   if (found != bindings.end()) {
-    auto js = "delete window['" + name + "'];";
-    init(js);
-    eval(js);
+    flush_bindings();
+    eval("window.__webview__.unbind(" + json::json_escape(name) + ")");
+    // The slot is reused with the next generation. Ids stay below 2^53 so
+    // that the page can keep them as numbers.
+    auto slot = static_cast<uint32_t>(found->second.id & 0xffffffff);
+    auto &entry = m_binding_ids[slot];
+    entry.context = nullptr;
+    entry.generation = (entry.generation + 1) & 0x1fffff;
+    m_free_binding_ids.push_back(slot);
     bindings.erase(found);
+    update_bindings_script();
   }
 }
 
-void webview::resolve(const std::string &seq, int status,
-                      const std::string &result) {
-  dispatch([seq, status, result, this]() {
-    if (status == 0) {
-      eval("window._rpc[" + seq + "].resolve(" + result +
-           "); delete window._rpc[" + seq + "]");
-    } else {
-      eval("window._rpc[" + seq + "].reject(" + result +
-           "); delete window._rpc[" + seq + "]");
+void webview::set_binding_timeout(const std::string &name,
+                                  unsigned timeout_ms) {
+  auto found = bindings.find(name);
+  if (found != bindings.end()) {
+    found->second.timeout_ms = timeout_ms;
+    // The page replaces the binding with one that has the new timeout
+    queue_binding(found->first, found->second);
+  }
+}
+
+cancel_token webview::get_cancel_token(const std::string &seq) {
+  // The call was resolved or cancelled already, so nobody waits for it
+  static const auto finished = std::make_shared<std::atomic<bool>>(true);
+  if (!is_valid_seq(seq)) {
+    return cancel_token(finished);
+  }
+  std::lock_guard<std::mutex> lock(m_resolve_mutex);
+  auto found = m_calls.find(seq_number(seq));
+  if (found == m_calls.end()) {
+    return cancel_token(finished);
+  }
+  auto &cancelled = found->second.cancelled;
+  if (!cancelled) {
+    cancelled = std::make_shared<std::atomic<bool>>(false);
+  }
+  return cancel_token(cancelled);
+}
+
+void webview::cancel(const std::string &seq) {
+  if (!is_valid_seq(seq)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_resolve_mutex);
+  auto found = m_calls.find(seq_number(seq));
+  if (found != m_calls.end()) {
+    if (found->second.cancelled) {
+      found->second.cancelled->store(true, std::memory_order_relaxed);
+    }
+    end_call(found);
+  }
+}
+
+void webview::begin_call(uint64_t seq) {
+  std::lock_guard<std::mutex> lock(m_resolve_mutex);
+  if (m_free_call_nodes.empty()) {
+    m_calls.emplace(seq, call_state{});
+    return;
+  }
+  auto node = std::move(m_free_call_nodes.back());
+  m_free_call_nodes.pop_back();
+  node.key() = seq;
+  m_calls.insert(std::move(node));
+}
+
+void webview::end_call(call_map::iterator call) {
+  // Nodes beyond this are freed
+  constexpr size_t max_free_nodes = 64;
+  if (m_free_call_nodes.size() == max_free_nodes) {
+    m_calls.erase(call);
+    return;
+  }
+  auto node = m_calls.extract(call);
+  node.mapped() = call_state{};
+  m_free_call_nodes.push_back(std::move(node));
+}
+
+void webview::leave_call(uint64_t seq, bool deferred) {
+  std::lock_guard<std::mutex> lock(m_resolve_mutex);
+  auto found = m_calls.find(seq);
+  if (found != m_calls.end() && !deferred && !found->second.cancelled) {
+    end_call(found);
+  }
+}
+
+void webview::set_thread_pool_size(size_t threads) {
+  m_thread_pool_size = threads;
+}
+
+void webview::trust_rpc_envelopes(bool enabled) {
+  m_trust_rpc_envelopes = enabled;
+}
+
+void webview::use_message_arenas(bool enabled) {
+  m_use_message_arenas = enabled;
+}
+
+void webview::resolve(std::string_view seq, int status,
+                      std::string_view result) {
+  if (!is_valid_seq(seq)) {
+    return;
+  }
+  if (!is_valid_result(result)) {
+    enqueue_result(seq, 1, invalid_result);
+    return;
+  }
+  enqueue_result(seq, status, result);
+}
+
+void webview::resolve(uint64_t seq, int status, std::string_view result) {
+  char digits[20];
+  auto end = std::to_chars(digits, digits + sizeof(digits), seq).ptr;
+  resolve({digits, static_cast<size_t>(end - digits)}, status, result);
+}
+
+void webview::resolve_batch(const call_result *results, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  // Results are checked before the lock is taken
+  std::vector<bool> valid(n);
+  size_t size = 0;
+  for (size_t i = 0; i < n; i++) {
+    valid[i] = is_valid_result(results[i].result);
+    size += results[i].seq.size() + results[i].result.size() + 32;
+  }
+  bool schedule;
+  {
+    // The batch is queued as a whole once there is room for one result
+    std::unique_lock<std::mutex> lock(m_resolve_mutex);
+    wait_for_result_space(lock);
+    m_pending_resolves.reserve(m_pending_resolves.size() + size);
+    for (size_t i = 0; i < n; i++) {
+      const auto &r = results[i];
+      if (!is_valid_seq(r.seq)) {
+        continue;
+      }
+      if (!valid[i]) {
+        append_call("settle(", r.seq, "false, ", invalid_result, true);
+        continue;
+      }
+      append_call("settle(", r.seq, r.status == 0 ? "true, " : "false, ",
+                  r.result, true);
     }
+    schedule = !m_resolve_scheduled;
+    m_resolve_scheduled = true;
+  }
+  if (schedule) {
+    browser_engine::dispatch([this] { flush_resolves(); });
+  }
+}
+
+bool webview::eval_batch(const std::string_view *scripts, size_t n,
+                         dispatch_policy policy) {
+  if (n == 0) {
+    return true;
+  }
+  // Each script is ended on a line of its own, so that a trailing line
+  // comment or a missing semicolon doesn't affect the next one
+  size_t size = 0;
+  for (size_t i = 0; i < n; i++) {
+    size += scripts[i].size() + 3;
+  }
+  std::string js;
+  js.reserve(size);
+  for (size_t i = 0; i < n; i++) {
+    js += scripts[i];
+    js += "\n;\n";
+  }
+  return dispatch([this, js = std::move(js)] { eval(js); }, policy);
+}
+
+void webview::send_chunk(const std::string &seq, const std::string &chunk) {
+  if (!is_valid_seq(seq) || !is_valid_result(chunk)) {
+    return;
+  }
+  enqueue_call("chunk(", seq, "", chunk, false);
+}
+
+void webview::emit(const std::string &event, const std::string &payload) {
+  if (!is_valid_result(payload)) {
+    return;
+  }
+  // The name of the event takes the place of the sequence number
+  enqueue_call("emit(", json::json_escape(event), "", payload, false);
+}
+
+void webview::enqueue_result(std::string_view seq, int status,
+                             std::string_view result) {
+  enqueue_call("settle(", seq, status == 0 ? "true, " : "false, ", result,
+               true);
+}
+
+void webview::enqueue_call(std::string_view function, std::string_view seq,
+                           std::string_view flag, std::string_view value,
+                           bool last) {
+  bool schedule;
+  {
+    std::unique_lock<std::mutex> lock(m_resolve_mutex);
+    wait_for_result_space(lock);
+    append_call(function, seq, flag, value, last);
+    schedule = !m_resolve_scheduled;
+    m_resolve_scheduled = true;
+  }
+  // Later results join the queue until the flush runs
+  if (schedule) {
+    browser_engine::dispatch([this] { flush_resolves(); });
+  }
+}
+
+void webview::wait_for_result_space(std::unique_lock<std::mutex> &lock) {
+  // Results are only delivered by the main thread, so it can't wait
+  if (std::this_thread::get_id() == m_main_thread) {
+    return;
+  }
+  m_resolve_space.wait(lock, [this] {
+    auto capacity = m_dispatch_capacity.load();
+    return capacity == 0 || m_pending_count < capacity || m_closing;
   });
 }
 
+void webview::append_call(std::string_view function, std::string_view seq,
+                          std::string_view flag, std::string_view value,
+                          bool last) {
+  if (last && !m_calls.empty()) {
+    auto found = m_calls.find(seq_number(seq));
+    if (found != m_calls.end()) {
+      end_call(found);
+    }
+  }
+  auto &calls = m_pending_resolves;
+  calls.reserve(calls.size() + seq.size() + value.size() + 32);
+  calls += function;
+  calls += seq;
+  calls += ", ";
+  calls += flag;
+  // An empty result used to resolve the promise with undefined
+  calls += value.empty() ? "undefined" : value;
+  calls += ");\n";
+  ++m_pending_count;
+}
+
+void webview::flush_resolves() {
+  // Results may come from bindings that the page doesn't know about yet
+  flush_bindings();
+  // The calls go to functions of the runtime that stay the same, so only
+  // the data changes between flushes
+  static const std::string prologue =
+      "(function(rpc) {\nif (!rpc) return;\n"
+      "var settle = rpc.settle, chunk = rpc.chunk, emit = rpc.emit;\n";
+  static const std::string epilogue = "})(window.__webview__)";
+  std::string js;
+  {
+    std::lock_guard<std::mutex> lock(m_resolve_mutex);
+    js.reserve(prologue.size() + m_pending_resolves.size() + epilogue.size());
+    js += prologue;
+    js += m_pending_resolves;
+    m_pending_resolves.clear();
+    m_pending_count = 0;
+    m_resolve_scheduled = false;
+  }
+  m_resolve_space.notify_all();
+  js += epilogue;
+  eval(js);
+}
+
 void webview::on_message(const std::string &msg) {
-  auto seq = json::json_parse(msg, "id", 0);
-  auto name = json::json_parse(msg, "method", 0);
-  auto args = json::json_parse(msg, "params", 0);
-  auto found = bindings.find(name);
-  if (found == bindings.end()) {
+#ifdef WEBVIEW_HAVE_PMR
+  if (m_use_message_arenas) {
+    // The parser state is released along with the arena
+    detail::arena_pool::lease arena(m_arenas);
+    json::tape tape(arena.resource());
+    json::params_view params(arena.resource());
+    on_message(msg, tape, params);
+    return;
+  }
+#endif
+  json::tape local_tape;
+  json::params_view local_params;
+  // Restores the flag even if a binding throws
+  struct parsing_guard {
+    bool &parsing;
+    bool reentrant;
+    ~parsing_guard() { parsing = reentrant; }
+  } guard{m_parsing, m_parsing};
+  m_parsing = true;
+  on_message(msg, guard.reentrant ? local_tape : m_tape,
+             guard.reentrant ? local_params : m_params);
+}
+
+void webview::on_message(const std::string &msg, json::tape &tape,
+                         json::params_view &params) {
+  // Calls that are too long to be posted at once arrive in pieces that
+  // start with '+', except for the last one, which starts with '.'
+  if (!msg.empty() && (msg[0] == '+' || msg[0] == '.')) {
+    on_message_piece(std::string_view(msg).substr(1), msg[0] == '.', tape,
+                     params);
+    return;
+  }
+  std::string_view id;
+  std::string_view seq;
+  std::string_view args;
+  auto call_slices = [&] {
+    auto context = find_binding(json::json_parse_digits(id.data(), id.size()));
+    if (context) {
+      call(*context, seq, args, tape, json::tape::npos, params);
+    }
+  };
+  if (m_trust_rpc_envelopes) {
+    if (json::json_slice_call(msg, id, seq, args)) {
+      call_slices();
+      return;
+    }
+    // Calls that were made in the same task arrive as an array of them.
+    // Those that can't be sliced, such as cancellations, are parsed alone.
+    auto slice = [&](std::string_view text) {
+      if (json::json_slice_call(text, id, seq, args)) {
+        call_slices();
+      } else if (tape.parse(text)) {
+        call(tape, 0, params);
+      }
+    };
+    if (json::json_slice_batch(msg, slice)) {
+      return;
+    }
+  }
+  if (tape.parse(msg)) {
+    // The message is tokenized once and calls are read from the tape. Calls
+    // that were made in the same task arrive as an array of them.
+    const auto &root = tape[0];
+    if (root.type == json::token_type::array && root.children > 0 &&
+        (tape[1].type == json::token_type::array ||
+         tape[1].type == json::token_type::object)) {
+      for (size_t i = 1; i < root.next; i = tape[i].next) {
+        call(tape, i, params);
+      }
+    } else {
+      call(tape, 0, params);
+    }
+  }
+}
+
+void webview::on_message_piece(std::string_view piece, bool last,
+                               json::tape &tape, json::params_view &params) {
+  // Once the reader fails it ignores the rest of the pieces
+  m_piece_reader.feed(piece);
+  if (!last) {
+    return;
+  }
+  auto complete = m_piece_reader.done();
+  m_piece_reader.reset();
+  // Taken so that the binding can receive the next call
+  auto method = std::move(m_piece_method);
+  auto seq = std::move(m_piece_seq);
+  auto args = std::move(m_piece_params);
+  m_piece_method.clear();
+  m_piece_seq.clear();
+  m_piece_params.clear();
+  if (!complete || method.empty() || seq.empty()) {
+    return;
+  }
+  args += args.empty() ? "[]" : "]";
+  // The method and sequence number are short and parsed as usual
+  const binding_ctx_t *context = nullptr;
+  if (!tape.parse(method)) {
+    return;
+  }
+  if (tape[0].type == json::token_type::string) {
+    std::string name;
+    auto found = bindings.find(std::string(tape.str(0, name)));
+    if (found != bindings.end()) {
+      context = &found->second;
+    }
+  } else {
+    int64_t id;
+    if (tape.number(0, id) && id >= 0) {
+      context = find_binding(static_cast<uint64_t>(id));
+    }
+  }
+  std::string seq_buffer;
+  if (!context || !tape.parse(seq)) {
     return;
   }
-  const auto &context = found->second;
-  context.callback(seq, args, context.arg);
+  seq = std::string(tape.str(0, seq_buffer));
+  call(*context, seq, args, tape, json::tape::npos, params);
+}
+
+void webview::call(json::tape &tape, size_t index,
+                   json::params_view &params) {
+  const binding_ctx_t *context = nullptr;
+  size_t seq;
+  size_t args;
+  if (tape[index].type == json::token_type::array) {
+    int64_t id;
+    if (!tape.number(tape.at(index, 0), id)) {
+      return;
+    }
+    // The page sends [-1,seq] when it stops waiting for a call
+    if (id == -1) {
+      seq = tape.at(index, 1);
+      if (seq != json::tape::npos) {
+        cancel(tape.str(seq));
+      }
+      return;
+    }
+    if (id < 0) {
+      return;
+    }
+    context = find_binding(static_cast<uint64_t>(id));
+    seq = tape.at(index, 1);
+    args = tape.at(index, 2);
+  } else {
+    // Envelopes with the name of the binding are still accepted
+    auto method = tape.find(index, "method");
+    if (method == json::tape::npos) {
+      return;
+    }
+    auto found = bindings.find(tape.str(method));
+    if (found != bindings.end()) {
+      context = &found->second;
+    }
+    seq = tape.find(index, "id");
+    args = tape.find(index, "params");
+  }
+  if (!context) {
+    return;
+  }
+  // Only sequence numbers with escape sequences are copied
+  detail::arena_string seq_buffer(detail::arena_allocator());
+  call(*context, seq == json::tape::npos ? "" : tape.str(seq, seq_buffer),
+       args == json::tape::npos ? "" : tape.text(args), tape, args, params);
+}
+
+void webview::call(const binding_ctx_t &context, std::string_view seq,
+                   std::string_view args, json::tape &tape, size_t args_index,
+                   json::params_view &params) {
+  // Calls without a sequence number that the runtime can settle are
+  // skipped, since their results couldn't be delivered
+  if (!is_valid_seq(seq)) {
+    return;
+  }
+  auto number = seq_number(seq);
+  begin_call(number);
+  if (context.thread == binding_thread::pool) {
+    call_on_pool(context, std::string(seq), std::string(args));
+    return;
+  }
+  struct call_scope {
+    webview &w;
+    uint64_t seq;
+    bool deferred;
+    ~call_scope() { w.leave_call(seq, deferred); }
+  } scope{*this, number, context.deferred};
+  try {
+    if (context.view_callback) {
+      context.view_callback(seq, args, context.arg);
+      return;
+    }
+    if (!context.params_callback) {
+      context.callback(std::string(seq), std::string(args), context.arg);
+      return;
+    }
+    // Only the params are tokenized if the call was sliced
+    if (args_index == json::tape::npos && !args.empty()) {
+      if (!tape.parse(args)) {
+        return;
+      }
+      args_index = 0;
+    }
+    params.reset(tape, args_index);
+    context.params_callback(std::string(seq), params, context.arg);
+  } catch (const std::exception &e) {
+    // The call is rejected like on the thread pool instead of unwinding
+    // through the main loop of the engine
+    resolve(seq, 1, json::json_escape(e.what()));
+  }
+}
+
+void webview::call_on_pool(const binding_ctx_t &context,
+                           const std::string &seq, std::string args) {
+  if (!m_thread_pool) {
+    m_thread_pool = std::make_unique<detail::thread_pool>(m_thread_pool_size);
+  }
+  // The binding is copied since it may be unbound before the task runs
+  m_thread_pool->submit([this, callback = context.callback,
+                         params_callback = context.params_callback,
+                         view_callback = context.view_callback,
+                         arg = context.arg, seq, args = std::move(args),
+                         deferred = context.deferred,
+                         use_arena = m_use_message_arenas] {
+    struct call_scope {
+      webview &w;
+      uint64_t seq;
+      bool deferred;
+      ~call_scope() { w.leave_call(seq, deferred); }
+    } scope{*this, seq_number(seq), deferred};
+#ifdef WEBVIEW_HAVE_PMR
+    std::optional<detail::arena_pool::lease> arena;
+    if (use_arena) {
+      arena.emplace(m_arenas);
+    }
+#else
+    (void)use_arena;
+#endif
+    try {
+      if (view_callback) {
+        view_callback(seq, args, arg);
+        return;
+      }
+      if (!params_callback) {
+        callback(seq, args, arg);
+        return;
+      }
+      auto call_with = [&](json::tape &tape, json::params_view &params) {
+        auto args_index = json::tape::npos;
+        if (!args.empty()) {
+          if (!tape.parse(args)) {
+            return;
+          }
+          args_index = 0;
+        }
+        params.reset(tape, args_index);
+        params_callback(seq, params, arg);
+      };
+#ifdef WEBVIEW_HAVE_PMR
+      if (arena) {
+        // The parser state is released along with the arena
+        json::tape tape(arena->resource());
+        json::params_view params(arena->resource());
+        call_with(tape, params);
+        return;
+      }
+#endif
+      // Each worker tokenizes params into a tape of its own
+      thread_local json::tape tape;
+      thread_local json::params_view params;
+      call_with(tape, params);
+    } catch (const std::exception &e) {
+      // There is no caller to pass the exception to on a worker
+      resolve(seq, 1, json::json_escape(e.what()));
+    }
+  });
 }
 } // namespace webview
\ No newline at end of file
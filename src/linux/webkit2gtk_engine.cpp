@@ -66,15 +66,33 @@ gtk_webkit_engine::gtk_webkit_engine(bool debug, void *window)
   gtk_widget_show_all(m_window);
 }
 
+gtk_webkit_engine::~gtk_webkit_engine() {
+  for (auto &s : m_user_scripts) {
+    webkit_user_script_unref(s.script);
+  }
+}
+
 void *gtk_webkit_engine::window() { return (void *)m_window; }
 void gtk_webkit_engine::run() { gtk_main(); }
-void gtk_webkit_engine::terminate() { gtk_main_quit(); }
+bool gtk_webkit_engine::step() {
+  while (!m_terminated && gtk_events_pending()) {
+    gtk_main_iteration_do(FALSE);
+  }
+  return !m_terminated;
+}
+void gtk_webkit_engine::terminate() {
+  m_terminated = true;
+  // There is no main loop to quit when the host calls step()
+  if (gtk_main_level() > 0) {
+    gtk_main_quit();
+  }
+}
 void gtk_webkit_engine::dispatch(std::function<void()> f) {
   g_idle_add_full(G_PRIORITY_HIGH_IDLE, (GSourceFunc)([](void *f) -> int {
                     (*static_cast<dispatch_fn_t *>(f))();
                     return G_SOURCE_REMOVE;
                   }),
-                  new std::function<void()>(f),
+                  new std::function<void()>(std::move(f)),
                   [](void *f) { delete static_cast<dispatch_fn_t *>(f); });
 }
 
@@ -103,23 +121,80 @@ void gtk_webkit_engine::navigate(const std::string &url) {
   webkit_web_view_load_uri(WEBKIT_WEB_VIEW(m_webview), url.c_str());
 }
 
-void gtk_webkit_engine::set_html(const std::string &html) {
-  webkit_web_view_load_html(WEBKIT_WEB_VIEW(m_webview), html.c_str(), nullptr);
+void gtk_webkit_engine::set_html(std::string_view html) {
+  // Same as webkit_web_view_load_html(), which needs a terminated string
+  auto *bytes = g_bytes_new(html.data(), html.size());
+  webkit_web_view_load_bytes(WEBKIT_WEB_VIEW(m_webview), bytes, "text/html",
+                             "UTF-8", nullptr);
+  g_bytes_unref(bytes);
 }
 
-void gtk_webkit_engine::init(const std::string &js) {
-  WebKitUserContentManager *manager =
-      webkit_web_view_get_user_content_manager(WEBKIT_WEB_VIEW(m_webview));
-  webkit_user_content_manager_add_script(
-      manager,
+void gtk_webkit_engine::init(const std::string &js) { add_user_script(js); }
+
+size_t gtk_webkit_engine::add_user_script(const std::string &js) {
+  auto *script =
       webkit_user_script_new(js.c_str(), WEBKIT_USER_CONTENT_INJECT_TOP_FRAME,
                              WEBKIT_USER_SCRIPT_INJECT_AT_DOCUMENT_START,
-                             nullptr, nullptr));
+                             nullptr, nullptr);
+  webkit_user_content_manager_add_script(content_manager(), script);
+  m_user_scripts.push_back({m_next_script_handle, script});
+  return m_next_script_handle++;
+}
+
+void gtk_webkit_engine::remove_user_script(size_t handle) {
+  for (auto it = m_user_scripts.begin(); it != m_user_scripts.end(); ++it) {
+    if (it->handle != handle) {
+      continue;
+    }
+#if WEBKIT_CHECK_VERSION(2, 32, 0)
+    webkit_user_content_manager_remove_script(content_manager(), it->script);
+    webkit_user_script_unref(it->script);
+    m_user_scripts.erase(it);
+#else
+    webkit_user_script_unref(it->script);
+    m_user_scripts.erase(it);
+    reinject_user_scripts();
+#endif
+    return;
+  }
 }
 
-void gtk_webkit_engine::eval(const std::string &js) {
-  webkit_web_view_run_javascript(WEBKIT_WEB_VIEW(m_webview), js.c_str(),
-                                 nullptr, nullptr, nullptr);
+void gtk_webkit_engine::replace_user_script(size_t handle,
+                                            const std::string &js) {
+  for (auto &s : m_user_scripts) {
+    if (s.handle == handle) {
+      webkit_user_script_unref(s.script);
+      s.script = webkit_user_script_new(
+          js.c_str(), WEBKIT_USER_CONTENT_INJECT_TOP_FRAME,
+          WEBKIT_USER_SCRIPT_INJECT_AT_DOCUMENT_START, nullptr, nullptr);
+      reinject_user_scripts();
+      return;
+    }
+  }
+}
+
+WebKitUserContentManager *gtk_webkit_engine::content_manager() {
+  return webkit_web_view_get_user_content_manager(WEBKIT_WEB_VIEW(m_webview));
+}
+
+void gtk_webkit_engine::reinject_user_scripts() {
+  auto *manager = content_manager();
+  webkit_user_content_manager_remove_all_scripts(manager);
+  for (auto &s : m_user_scripts) {
+    webkit_user_content_manager_add_script(manager, s.script);
+  }
+}
+
+void gtk_webkit_engine::eval(std::string_view js) {
+#if WEBKIT_CHECK_VERSION(2, 40, 0)
+  webkit_web_view_evaluate_javascript(
+      WEBKIT_WEB_VIEW(m_webview), js.data(), static_cast<gssize>(js.size()),
+      nullptr, nullptr, nullptr, nullptr, nullptr);
+#else
+  webkit_web_view_run_javascript(WEBKIT_WEB_VIEW(m_webview),
+                                 std::string(js).c_str(), nullptr, nullptr,
+                                 nullptr);
+#endif
 }
 
 char *webview::gtk_webkit_engine::get_string_from_js_result(
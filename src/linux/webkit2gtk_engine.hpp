@@ -4,8 +4,11 @@
 #include <gtk/gtk.h>
 #include <webkit2/webkit2.h>
 
+#include <atomic>
 #include <functional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "webview.h"
 
@@ -16,9 +19,13 @@ using dispatch_fn_t = std::function<void()>;
 class gtk_webkit_engine {
 public:
   gtk_webkit_engine(bool debug, void *window);
-  virtual ~gtk_webkit_engine() = default;
+  virtual ~gtk_webkit_engine();
   void *window();
   void run();
+  // Handles the events that are ready without waiting for more, for hosts
+  // that run a loop of their own instead of run(). Returns false once
+  // terminate() was called.
+  bool step();
   void terminate();
   void dispatch(std::function<void()> f);
 
@@ -28,19 +35,37 @@ public:
 
   void navigate(const std::string &url);
 
-  void set_html(const std::string &html);
+  void set_html(std::string_view html);
 
   void init(const std::string &js);
 
-  void eval(const std::string &js);
+  // Same as init(), but returns a handle for removing or replacing the
+  // script later. Scripts keep running in the order they were added in.
+  size_t add_user_script(const std::string &js);
+  void remove_user_script(size_t handle);
+  void replace_user_script(size_t handle, const std::string &js);
+
+  void eval(std::string_view js);
 
 private:
   virtual void on_message(const std::string &msg) = 0;
 
   static char *get_string_from_js_result(WebKitJavascriptResult *r);
 
+  WebKitUserContentManager *content_manager();
+  // Adds the scripts to the page again so that their order is kept
+  void reinject_user_scripts();
+
   GtkWidget *m_window;
   GtkWidget *m_webview;
+  struct user_script {
+    size_t handle;
+    WebKitUserScript *script;
+  };
+  std::vector<user_script> m_user_scripts;
+  size_t m_next_script_handle = 1;
+  // Written by terminate(), which may run on any thread
+  std::atomic_bool m_terminated{false};
 };
 
 using browser_engine = gtk_webkit_engine;
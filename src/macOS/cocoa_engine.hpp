@@ -4,8 +4,11 @@
 #include <objc/NSObjCRuntime.h>
 #include <objc/objc-runtime.h>
 
+#include <atomic>
 #include <functional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "webview.h"
 
@@ -51,6 +54,10 @@ enum WKUserScriptInjectionTime : NSInteger {
 
 enum NSModalResponse : NSInteger { NSModalResponseOK = 1 };
 
+enum NSStringEncoding : NSUInteger { NSUTF8StringEncoding = 4 };
+
+enum NSEventMask : unsigned long long { NSEventMaskAny = ~0ull };
+
 // Convenient conversion of string literals.
 inline id operator"" _cls(const char *s, std::size_t) {
   return (id)objc_getClass(s);
@@ -66,17 +73,26 @@ class cocoa_wkwebview_engine {
 public:
   cocoa_wkwebview_engine(bool debug, void *window);
 
-  virtual ~cocoa_wkwebview_engine() = default;
+  virtual ~cocoa_wkwebview_engine();
   void *window();
   void terminate();
   void run();
+  // Handles the events that are ready without waiting for more, for hosts
+  // that run a loop of their own instead of run(). Returns false once
+  // terminate() was called.
+  bool step();
   void dispatch(std::function<void()> f);
   void set_title(const std::string &title);
   void set_size(int width, int height, int hints);
   void navigate(const std::string &url);
-  void set_html(const std::string &html);
+  void set_html(std::string_view html);
   void init(const std::string &js);
-  void eval(const std::string &js);
+  // Same as init(), but returns a handle for removing or replacing the
+  // script later. Scripts keep running in the order they were added in.
+  size_t add_user_script(const std::string &js);
+  void remove_user_script(size_t handle);
+  void replace_user_script(size_t handle, const std::string &js);
+  void eval(std::string_view js);
 
 private:
   virtual void on_message(const std::string &msg) = 0;
@@ -88,12 +104,27 @@ private:
   static id get_main_bundle() noexcept;
   static bool is_app_bundled() noexcept;
   void on_application_did_finish_launching(id delegate, id app);
+  static id create_user_script(const std::string &js);
+  // Returns an autoreleased NSString with a copy of the UTF-8 text
+  static id create_string(std::string_view s);
+  // Adds the scripts to the page again so that their order is kept
+  void reinject_user_scripts();
   bool m_debug;
 
   void *m_parent_window;
   id m_window;
   id m_webview;
   id m_manager;
+  struct user_script {
+    size_t handle;
+    id script;
+  };
+  std::vector<user_script> m_user_scripts;
+  size_t m_next_script_handle = 1;
+  // Set by step(), in which case terminate() leaves the app running. Both
+  // are atomic because terminate() may run on any thread.
+  std::atomic_bool m_stepping{false};
+  std::atomic_bool m_terminated{false};
 };
 
 using browser_engine = cocoa_wkwebview_engine;
@@ -41,8 +41,17 @@ cocoa_wkwebview_engine::cocoa_wkwebview_engine(bool debug, void *window)
     objc::msg_send<void>(app, "run"_sel);
   }
 }
+cocoa_wkwebview_engine::~cocoa_wkwebview_engine() {
+  for (auto &s : m_user_scripts) {
+    objc::msg_send<void>(s.script, "release"_sel);
+  }
+}
 void *cocoa_wkwebview_engine::window() { return (void *)m_window; }
 void cocoa_wkwebview_engine::terminate() {
+  m_terminated = true;
+  if (m_stepping) {
+    return;
+  }
   id app = get_shared_application();
   objc::msg_send<void>(app, "terminate:"_sel, nullptr);
 }
@@ -50,8 +59,26 @@ void cocoa_wkwebview_engine::run() {
   id app = get_shared_application();
   objc::msg_send<void>(app, "run"_sel);
 }
+bool cocoa_wkwebview_engine::step() {
+  m_stepping = true;
+  id app = get_shared_application();
+  id past = objc::msg_send<id>("NSDate"_cls, "distantPast"_sel);
+  while (!m_terminated) {
+    // Equivalent Obj-C:
+    // [app nextEventMatchingMask:NSEventMaskAny untilDate:[NSDate distantPast] inMode:NSDefaultRunLoopMode dequeue:YES]
+    // This also runs functions that were dispatched to the main queue.
+    id event = objc::msg_send<id>(
+        app, "nextEventMatchingMask:untilDate:inMode:dequeue:"_sel,
+        NSEventMaskAny, past, (id)kCFRunLoopDefaultMode, YES);
+    if (!event) {
+      break;
+    }
+    objc::msg_send<void>(app, "sendEvent:"_sel, event);
+  }
+  return !m_terminated;
+}
 void cocoa_wkwebview_engine::dispatch(std::function<void()> f) {
-  dispatch_async_f(dispatch_get_main_queue(), new dispatch_fn_t(f),
+  dispatch_async_f(dispatch_get_main_queue(), new dispatch_fn_t(std::move(f)),
                    (dispatch_function_t)([](void *arg) {
                      auto f = static_cast<dispatch_fn_t *>(arg);
                      (*f)();
@@ -95,31 +122,70 @@ void cocoa_wkwebview_engine::navigate(const std::string &url) {
       m_webview, "loadRequest:"_sel,
       objc::msg_send<id>("NSURLRequest"_cls, "requestWithURL:"_sel, nsurl));
 }
-void cocoa_wkwebview_engine::set_html(const std::string &html) {
+void cocoa_wkwebview_engine::set_html(std::string_view html) {
   objc::msg_send<void>(m_webview, "loadHTMLString:baseURL:"_sel,
-                       objc::msg_send<id>("NSString"_cls,
-                                          "stringWithUTF8String:"_sel,
-                                          html.c_str()),
-                       nullptr);
+                       create_string(html), nullptr);
 }
 void cocoa_wkwebview_engine::init(const std::string &js) {
+  add_user_script(js);
+}
+size_t cocoa_wkwebview_engine::add_user_script(const std::string &js) {
+  auto script = create_user_script(js);
+  objc::msg_send<void>(m_manager, "addUserScript:"_sel, script);
+  m_user_scripts.push_back({m_next_script_handle, script});
+  return m_next_script_handle++;
+}
+void cocoa_wkwebview_engine::remove_user_script(size_t handle) {
+  for (auto it = m_user_scripts.begin(); it != m_user_scripts.end(); ++it) {
+    if (it->handle == handle) {
+      objc::msg_send<void>(it->script, "release"_sel);
+      m_user_scripts.erase(it);
+      // WKUserContentController can only remove all scripts at once
+      reinject_user_scripts();
+      return;
+    }
+  }
+}
+void cocoa_wkwebview_engine::replace_user_script(size_t handle,
+                                                 const std::string &js) {
+  for (auto &s : m_user_scripts) {
+    if (s.handle == handle) {
+      objc::msg_send<void>(s.script, "release"_sel);
+      s.script = create_user_script(js);
+      reinject_user_scripts();
+      return;
+    }
+  }
+}
+id cocoa_wkwebview_engine::create_user_script(const std::string &js) {
   // Equivalent Obj-C:
-  // [m_manager addUserScript:[[WKUserScript alloc] initWithSource:[NSString stringWithUTF8String:js.c_str()] injectionTime:WKUserScriptInjectionTimeAtDocumentStart forMainFrameOnly:YES]]
-  objc::msg_send<void>(
-      m_manager, "addUserScript:"_sel,
-      objc::msg_send<id>(objc::msg_send<id>("WKUserScript"_cls, "alloc"_sel),
-                         "initWithSource:injectionTime:forMainFrameOnly:"_sel,
-                         objc::msg_send<id>("NSString"_cls,
-                                            "stringWithUTF8String:"_sel,
-                                            js.c_str()),
-                         WKUserScriptInjectionTimeAtDocumentStart, YES));
+  // [[WKUserScript alloc] initWithSource:[NSString stringWithUTF8String:js.c_str()] injectionTime:WKUserScriptInjectionTimeAtDocumentStart forMainFrameOnly:YES]
+  return objc::msg_send<id>(
+      objc::msg_send<id>("WKUserScript"_cls, "alloc"_sel),
+      "initWithSource:injectionTime:forMainFrameOnly:"_sel,
+      objc::msg_send<id>("NSString"_cls, "stringWithUTF8String:"_sel,
+                         js.c_str()),
+      WKUserScriptInjectionTimeAtDocumentStart, YES);
 }
-void cocoa_wkwebview_engine::eval(const std::string &js) {
+void cocoa_wkwebview_engine::reinject_user_scripts() {
+  objc::msg_send<void>(m_manager, "removeAllUserScripts"_sel);
+  for (auto &s : m_user_scripts) {
+    objc::msg_send<void>(m_manager, "addUserScript:"_sel, s.script);
+  }
+}
+void cocoa_wkwebview_engine::eval(std::string_view js) {
   objc::msg_send<void>(m_webview, "evaluateJavaScript:completionHandler:"_sel,
-                       objc::msg_send<id>("NSString"_cls,
-                                          "stringWithUTF8String:"_sel,
-                                          js.c_str()),
-                       nullptr);
+                       create_string(js), nullptr);
+}
+id cocoa_wkwebview_engine::create_string(std::string_view s) {
+  // Equivalent Obj-C:
+  // [[[NSString alloc] initWithBytes:s.data() length:s.size() encoding:NSUTF8StringEncoding] autorelease]
+  return objc::msg_send<id>(
+      objc::msg_send<id>(objc::msg_send<id>("NSString"_cls, "alloc"_sel),
+                         "initWithBytes:length:encoding:"_sel, s.data(),
+                         static_cast<NSUInteger>(s.size()),
+                         NSUTF8StringEncoding),
+      "autorelease"_sel);
 }
 
 id cocoa_wkwebview_engine::create_app_delegate() {
@@ -105,24 +105,42 @@ void win32_edge_engine::run() {
   MSG msg;
   BOOL res;
   while ((res = GetMessage(&msg, nullptr, 0, 0)) != -1) {
-    if (msg.hwnd) {
-      TranslateMessage(&msg);
-      DispatchMessage(&msg);
-      continue;
-    }
-    if (msg.message == WM_APP) {
-      auto f = (dispatch_fn_t *)(msg.lParam);
-      (*f)();
-      delete f;
-    } else if (msg.message == WM_QUIT) {
+    if (!process_message(msg)) {
       return;
     }
   }
 }
+
+bool win32_edge_engine::step() {
+  MSG msg;
+  while (!m_terminated && PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+    if (!process_message(msg)) {
+      m_terminated = true;
+    }
+  }
+  return !m_terminated;
+}
+
+bool win32_edge_engine::process_message(MSG &msg) {
+  if (msg.hwnd) {
+    TranslateMessage(&msg);
+    DispatchMessage(&msg);
+    return true;
+  }
+  if (msg.message == WM_APP) {
+    auto f = (dispatch_fn_t *)(msg.lParam);
+    (*f)();
+    delete f;
+  } else if (msg.message == WM_QUIT) {
+    return false;
+  }
+  return true;
+}
 void *win32_edge_engine::window() { return (void *)m_window; }
 void win32_edge_engine::terminate() { PostQuitMessage(0); }
 void win32_edge_engine::dispatch(dispatch_fn_t f) {
-  PostThreadMessage(m_main_thread, WM_APP, 0, (LPARAM) new dispatch_fn_t(f));
+  PostThreadMessage(m_main_thread, WM_APP, 0,
+                    (LPARAM) new dispatch_fn_t(std::move(f)));
 }
 
 void win32_edge_engine::set_title(const std::string &title) {
@@ -162,17 +180,75 @@ void win32_edge_engine::navigate(const std::string &url) {
   m_webview->Navigate(wurl.c_str());
 }
 
-void win32_edge_engine::init(const std::string &js) {
-  auto wjs = webview::wstring::widen_string(js);
-  m_webview->AddScriptToExecuteOnDocumentCreated(wjs.c_str(), nullptr);
+void win32_edge_engine::init(const std::string &js) { add_user_script(js); }
+
+size_t win32_edge_engine::add_user_script(const std::string &js) {
+  m_user_scripts.push_back(
+      {m_next_script_handle, webview::wstring::widen_string(js), {}, 0});
+  add_script_to_webview(m_user_scripts.back());
+  return m_next_script_handle++;
+}
+
+void win32_edge_engine::remove_user_script(size_t handle) {
+  for (auto it = m_user_scripts.begin(); it != m_user_scripts.end(); ++it) {
+    if (it->handle != handle) {
+      continue;
+    }
+    // If the ID hasn't been reported yet then the script is removed when it
+    // is, because by then it's no longer in the list.
+    if (!it->id.empty()) {
+      m_webview->RemoveScriptToExecuteOnDocumentCreated(it->id.c_str());
+    }
+    m_user_scripts.erase(it);
+    return;
+  }
+}
+
+void win32_edge_engine::replace_user_script(size_t handle,
+                                            const std::string &js) {
+  auto it = m_user_scripts.begin();
+  while (it != m_user_scripts.end() && it->handle != handle) {
+    ++it;
+  }
+  if (it == m_user_scripts.end()) {
+    return;
+  }
+  it->js = webview::wstring::widen_string(js);
+  // Scripts run in the order they were added in, so the ones after the
+  // replaced script have to be added again as well.
+  for (; it != m_user_scripts.end(); ++it) {
+    if (!it->id.empty()) {
+      m_webview->RemoveScriptToExecuteOnDocumentCreated(it->id.c_str());
+      it->id.clear();
+    }
+    add_script_to_webview(*it);
+  }
+}
+
+void win32_edge_engine::add_script_to_webview(user_script &script) {
+  auto handle = script.handle;
+  auto generation = script.generation = ++m_script_generation;
+  auto *handler = new script_added_handler([this, handle,
+                                            generation](LPCWSTR id) {
+    for (auto &s : m_user_scripts) {
+      if (s.handle == handle && s.generation == generation) {
+        s.id = id;
+        return;
+      }
+    }
+    // The script was removed or replaced before it had been added
+    m_webview->RemoveScriptToExecuteOnDocumentCreated(id);
+  });
+  m_webview->AddScriptToExecuteOnDocumentCreated(script.js.c_str(), handler);
+  handler->Release();
 }
 
-void win32_edge_engine::eval(const std::string &js) {
+void win32_edge_engine::eval(std::string_view js) {
   auto wjs = webview::wstring::widen_string(js);
   m_webview->ExecuteScript(wjs.c_str(), nullptr);
 }
 
-void win32_edge_engine::set_html(const std::string &html) {
+void win32_edge_engine::set_html(std::string_view html) {
   m_webview->NavigateToString(webview::wstring::widen_string(html).c_str());
 }
 
@@ -18,6 +18,9 @@
 #include "WebView2.h"
 
 #include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "shared/library_symbol.hpp"
 #include "shared/native_library.hpp"
@@ -36,6 +39,7 @@ using dispatch_fn_t = std::function<void()>;
 using msg_cb_t = std::function<void(const std::string)>;
 
 using com_event_handler = webview::webview2_loader::com_event_handler;
+using script_added_handler = webview::webview2_loader::script_added_handler;
 
 struct user32_symbols {
   using DPI_AWARENESS_CONTEXT = HANDLE;
@@ -89,6 +93,10 @@ public:
   win32_edge_engine &operator=(win32_edge_engine &&other) = delete;
 
   void run();
+  // Handles the events that are ready without waiting for more, for hosts
+  // that run a loop of their own instead of run(). Returns false once
+  // terminate() was called.
+  bool step();
   void *window();
   void terminate();
   void dispatch(dispatch_fn_t f);
@@ -101,9 +109,15 @@ public:
 
   void init(const std::string &js);
 
-  void eval(const std::string &js);
+  // Same as init(), but returns a handle for removing or replacing the
+  // script later. Scripts keep running in the order they were added in.
+  size_t add_user_script(const std::string &js);
+  void remove_user_script(size_t handle);
+  void replace_user_script(size_t handle, const std::string &js);
 
-  void set_html(const std::string &html);
+  void eval(std::string_view js);
+
+  void set_html(std::string_view html);
 
 private:
   bool embed(HWND wnd, bool debug, msg_cb_t cb);
@@ -112,8 +126,29 @@ private:
 
   bool is_webview2_available() const noexcept;
 
+  // Handles a message of the thread. Returns false for WM_QUIT.
+  bool process_message(MSG &msg);
+
   virtual void on_message(const std::string &msg) = 0;
 
+  struct user_script {
+    size_t handle;
+    std::wstring js;
+    // Empty until WebView2 has reported the ID of the added script
+    std::wstring id;
+    // Tells the ID of the latest addition of the script from those of
+    // earlier ones that were replaced before their IDs were reported
+    unsigned generation;
+  };
+
+  // Adds the script to the page and stores its ID once it is reported
+  void add_script_to_webview(user_script &script);
+
+  std::vector<user_script> m_user_scripts;
+  size_t m_next_script_handle = 1;
+  unsigned m_script_generation = 0;
+  bool m_terminated = false;
+
   // The app is expected to call CoInitializeEx before
   // CreateCoreWebView2EnvironmentWithOptions.
   // Source: https://docs.microsoft.com/en-us/microsoft-edge/webview2/reference/win32/webview2-idl#createcorewebview2environmentwithoptions
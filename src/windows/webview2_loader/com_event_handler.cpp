@@ -132,5 +132,43 @@ void com_event_handler::try_create_environment() noexcept {
   m_cb(nullptr, nullptr);
 }
 
+script_added_handler::script_added_handler(id_cb_t cb) : m_cb(cb) {}
+
+ULONG STDMETHODCALLTYPE script_added_handler::AddRef() {
+  return ++m_ref_count;
+}
+
+ULONG STDMETHODCALLTYPE script_added_handler::Release() {
+  if (m_ref_count > 1) {
+    return --m_ref_count;
+  }
+  delete this;
+  return 0;
+}
+
+HRESULT STDMETHODCALLTYPE script_added_handler::QueryInterface(REFIID riid,
+                                                               LPVOID *ppv) {
+  if (!ppv) {
+    return E_POINTER;
+  }
+  if (IsEqualIID(riid, cast_info::script_added.iid)) {
+    *ppv = static_cast<
+        ICoreWebView2AddScriptToExecuteOnDocumentCreatedCompletedHandler *>(
+        this);
+    AddRef();
+    return S_OK;
+  }
+  *ppv = nullptr;
+  return E_NOINTERFACE;
+}
+
+HRESULT STDMETHODCALLTYPE script_added_handler::Invoke(HRESULT res,
+                                                       LPCWSTR id) {
+  if (SUCCEEDED(res) && id) {
+    m_cb(id);
+  }
+  return S_OK;
+}
+
 } // namespace webview2_loader
 } // namespace webview
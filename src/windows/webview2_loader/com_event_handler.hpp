@@ -32,6 +32,10 @@ static constexpr IID IID_ICoreWebView2PermissionRequestedEventHandler{
     0x15E1C6A3, 0xC72A, 0x4DF3, 0x91, 0xD7, 0xD0, 0x97, 0xFB, 0xEC, 0x6B, 0xFD};
 static constexpr IID IID_ICoreWebView2WebMessageReceivedEventHandler{
     0x57213F19, 0x00E6, 0x49FA, 0x8E, 0x07, 0x89, 0x8E, 0xA0, 0x1E, 0xCB, 0xD2};
+static constexpr IID
+    IID_ICoreWebView2AddScriptToExecuteOnDocumentCreatedCompletedHandler{
+        0xB99369F3, 0x9B11, 0x47B5, 0xBC, 0x6F, 0x8E,
+        0x78,       0x95,   0xFC,   0xEA, 0x17};
 
 static constexpr auto controller_completed =
     cast_info_t<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>{
@@ -48,6 +52,10 @@ static constexpr auto message_received =
 static constexpr auto permission_requested =
     cast_info_t<ICoreWebView2PermissionRequestedEventHandler>{
         IID_ICoreWebView2PermissionRequestedEventHandler};
+
+static constexpr auto script_added = cast_info_t<
+    ICoreWebView2AddScriptToExecuteOnDocumentCreatedCompletedHandler>{
+    IID_ICoreWebView2AddScriptToExecuteOnDocumentCreatedCompletedHandler};
 } // namespace cast_info
 
 class com_event_handler
@@ -113,5 +121,29 @@ private:
   unsigned int m_attempts = 0;
 };
 
+// Receives the ID of a script added with AddScriptToExecuteOnDocumentCreated,
+// which is needed for removing the script again.
+class script_added_handler
+    : public ICoreWebView2AddScriptToExecuteOnDocumentCreatedCompletedHandler {
+public:
+  using id_cb_t = std::function<void(LPCWSTR id)>;
+
+  script_added_handler(id_cb_t cb);
+  virtual ~script_added_handler() = default;
+  script_added_handler(const script_added_handler &other) = delete;
+  script_added_handler &operator=(const script_added_handler &other) = delete;
+  script_added_handler(script_added_handler &&other) = delete;
+  script_added_handler &operator=(script_added_handler &&other) = delete;
+
+  ULONG STDMETHODCALLTYPE AddRef();
+  ULONG STDMETHODCALLTYPE Release();
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, LPVOID *ppv);
+  HRESULT STDMETHODCALLTYPE Invoke(HRESULT res, LPCWSTR id);
+
+private:
+  id_cb_t m_cb;
+  std::atomic<ULONG> m_ref_count{1};
+};
+
 } // namespace webview2_loader
 } // namespace webview
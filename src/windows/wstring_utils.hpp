@@ -1,19 +1,20 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <windows.h>
 
 namespace webview {
 namespace wstring {
 
 // Converts a narrow (UTF-8-encoded) string into a wide (UTF-16-encoded) string.
-inline std::wstring widen_string(const std::string &input) {
+inline std::wstring widen_string(std::string_view input) {
   if (input.empty()) {
     return std::wstring();
   }
   UINT cp = CP_UTF8;
   DWORD flags = MB_ERR_INVALID_CHARS;
-  auto input_c = input.c_str();
+  auto input_c = input.data();
   auto input_length = static_cast<int>(input.size());
   auto required_length =
       MultiByteToWideChar(cp, flags, input_c, input_length, nullptr, 0);
@@ -1,16 +1,21 @@
-//bin/echo; [ $(uname) = "Darwin" ] && FLAGS="-framework Webkit" || FLAGS="$(pkg-config --cflags --libs gtk+-3.0 webkit2gtk-4.0)" ; c++ "$0" $FLAGS -std=c++11 -Wall -Wextra -pedantic -g -o webview_test && ./webview_test ; exit
+//bin/echo; [ $(uname) = "Darwin" ] && FLAGS="-framework Webkit" || FLAGS="$(pkg-config --cflags --libs gtk+-3.0 webkit2gtk-4.0)" ; c++ "$0" $FLAGS -std=c++17 -Wall -Wextra -pedantic -g -o webview_test && ./webview_test ; exit
 // +build ignore
 
 #include "webview.hpp"
 
 #include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 // =================================================================
 // TEST: start app loop and terminate it.
@@ -109,6 +114,118 @@ static void test_c_api_bind() {
   webview_run(w);
 }
 
+// =================================================================
+// TEST: use the C API with strings that aren't null-terminated.
+// =================================================================
+static void test_c_api_sized_strings() {
+  auto echo = +[](const char *seq, size_t seq_len, const char *req,
+                  size_t req_len, void *arg) {
+    // The params are ["a\u0000b"], the result is the string of them
+    std::string_view params(req, req_len);
+    assert(params == R"(["a\u0000b"])");
+    webview_return_n(arg, seq, seq_len, 0, params.data() + 1,
+                     params.size() - 2);
+  };
+  auto done = +[](const char *, const char *req, void *arg) {
+    assert(std::string(req) == "[true]");
+    webview_terminate(arg);
+  };
+  auto w = webview_create(false, nullptr);
+  webview_bind_n(w, "echo", echo, w);
+  webview_bind(w, "done", done, w);
+  // Only the given sizes are used, the rest of each buffer is garbage
+  const char init[] = "window.ready = true;garbage";
+  webview_init_n(w, init, sizeof(init) - 8);
+  const char html[] = "<script>\n"
+                      "  window.echo('a\\u0000b').then(s => window.done(\n"
+                      "      window.ready && s === 'a\\u0000b'));\n"
+                      "</script>garbage";
+  webview_set_html_n(w, html, sizeof(html) - 8);
+  webview_run(w);
+  webview_destroy(w);
+}
+
+// =================================================================
+// TEST: use the C API to return results and run scripts in batches.
+// =================================================================
+static void test_c_api_batch() {
+  struct context_t {
+    webview_t w;
+    std::vector<std::string> seqs;
+  } context{};
+  auto square = +[](const char *seq, const char *, void *arg) {
+    auto context = static_cast<context_t *>(arg);
+    context->seqs.emplace_back(seq);
+    if (context->seqs.size() < 3) {
+      return;
+    }
+    // The scripts run before the results are delivered
+    const char *scripts[] = {"window.a = 1 // no semicolon", "window.b = 2"};
+    webview_eval_batch(context->w, scripts, nullptr, 2);
+    const char *results[] = {"1", "4", "\"failed\""};
+    webview_result_t batch[3];
+    for (size_t i = 0; i < 3; i++) {
+      const auto &seq = context->seqs[i];
+      batch[i] = {seq.data(), seq.size(), i < 2 ? 0 : 1, results[i],
+                  strlen(results[i])};
+    }
+    webview_return_batch(context->w, batch, 3);
+  };
+  auto done = +[](const char *, const char *req, void *arg) {
+    assert(std::string(req) == "[true]");
+    webview_terminate(static_cast<context_t *>(arg)->w);
+  };
+  auto w = webview_create(false, nullptr);
+  context.w = w;
+  webview_bind(w, "square", square, &context);
+  webview_bind(w, "done", done, &context);
+  webview_set_html(w, R"(<script>
+    Promise.all([window.square(1), window.square(2),
+                 window.square(3).catch(e => e)])
+        .then(r => window.done(r[0] === 1 && r[1] === 4 &&
+                               r[2] === 'failed' && window.a === 1 &&
+                               window.b === 2));
+  </script>)");
+  webview_run(w);
+  webview_destroy(w);
+}
+
+// =================================================================
+// TEST: use the C API to poll for calls in a loop of the host.
+// =================================================================
+static void test_c_api_poll_messages() {
+  auto w = webview_create(false, nullptr);
+  webview_bind_polled(w, "square");
+  webview_bind_polled(w, "done");
+  // Nothing is queued yet, so the queue can still be resized
+  assert(webview_set_poll_capacity(w, 16));
+  webview_set_html(w, R"(<script>
+    Promise.all([1, 2, 3].map(n => window.square(n)))
+        .then(r => window.done(r.join() === '1,4,9'));
+  </script>)");
+  webview_message_t messages[16];
+  bool finished = false;
+  while (webview_step(w)) {
+    auto n = webview_poll_messages(w, messages, 16);
+    for (size_t i = 0; i < n; i++) {
+      const auto &m = messages[i];
+      std::string method(m.method, m.method_len);
+      std::string params(m.params, m.params_len);
+      if (method == "done") {
+        assert(params == "[true]");
+        finished = true;
+        webview_terminate(w);
+        break;
+      }
+      assert(method == "square" && params.size() == 3);
+      auto result = std::to_string((params[1] - '0') * (params[1] - '0'));
+      webview_return_n(w, m.seq, m.seq_len, 0, result.data(), result.size());
+    }
+  }
+  assert(finished);
+  webview_destroy(w);
+}
+
 // =================================================================
 // TEST: test synchronous binding and unbinding.
 // =================================================================
@@ -160,6 +277,710 @@ static void test_sync_bind() {
   w.run();
 }
 
+// =================================================================
+// TEST: test binding with random access to the parsed params.
+// =================================================================
+
+static void test_params_bind() {
+  webview::webview w(false, nullptr);
+  w.bind(
+      "test",
+      [&](const std::string & /*seq*/,
+          const webview::json::params_view &params, void * /*arg*/) {
+        assert(params.size() == 3);
+        assert(params.str(0) == "foo");
+        assert(params.text(1) == "1");
+        assert(params.text(2) == "[2,3]");
+        w.terminate();
+      },
+      nullptr);
+  w.set_html("<script>window.test('foo', 1, [2, 3]);</script>");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that stub envelopes reach bindings when they are trusted.
+// =================================================================
+static void test_trusted_envelopes() {
+  webview::webview w(false, nullptr);
+  w.trust_rpc_envelopes(true);
+  w.bind(
+      "first",
+      [&](const std::string &seq, const std::string &req, void * /*arg*/) {
+        assert(seq == "1");
+        assert(req == R"(["foo",{"a":[1]}])");
+      },
+      nullptr);
+  w.bind(
+      "second",
+      [&](const std::string &seq, const webview::json::params_view &params,
+          void * /*arg*/) {
+        assert(seq == "2");
+        assert(params.size() == 2);
+        assert(params.str(0) == "bar");
+        assert(params.text(1) == "[2,3]");
+        w.terminate();
+      },
+      nullptr);
+  w.set_html("<script>window.first('foo', {a: [1]});"
+             "window.second('bar', [2, 3]);</script>");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that typed bindings decode params and encode results.
+// =================================================================
+static void test_typed_bind() {
+  webview::webview w(false, nullptr);
+  w.bind("sum", [](int a, double b, const std::vector<int> &c) {
+    double sum = a + b;
+    for (auto n : c) {
+      sum += n;
+    }
+    return sum;
+  });
+  w.bind("join", [](std::string_view a, std::string b) {
+    return std::string(a) + b;
+  });
+  w.bind("done", [&](bool ok, std::optional<int> missing) {
+    assert(ok && !missing);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    Promise.all([window.sum(1, 0.5, [2, 3]), window.join('a\n', 'b'),
+                 window.sum('x', 1, [])
+                     .then(() => 'resolved', () => 'rejected')])
+        .then(r => window.done(r[0] === 6.5 && r[1] === 'a\nb' &&
+                               r[2] === 'rejected'));
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that a burst of results from other threads arrives in order.
+// =================================================================
+static void test_resolve_burst() {
+  webview::webview w(false, nullptr);
+  std::vector<std::string> seqs;
+  w.bind(
+      "collect",
+      [&](const std::string &seq, const std::string & /*req*/, void *) {
+        seqs.push_back(seq);
+        if (seqs.size() < 1000) {
+          return;
+        }
+        std::thread([&] {
+          for (size_t i = 0; i < seqs.size(); i++) {
+            w.resolve(seqs[i], 0, std::to_string(i));
+          }
+        }).detach();
+      },
+      nullptr);
+  w.bind("done", [&](bool ok) {
+    assert(ok);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    var order = [];
+    var calls = [];
+    for (var i = 0; i < 1000; i++) {
+      calls.push(window.collect().then(n => order.push(n)));
+    }
+    Promise.all(calls).then(() =>
+        window.done(order.every((n, i) => n === i)));
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that calls made in the same task are delivered in order.
+// =================================================================
+static void test_batched_calls() {
+  webview::webview w(false, nullptr);
+  std::vector<int> received;
+  w.bind("log", [&](int n) { received.push_back(n); });
+  w.bind("done", [&]() {
+    assert(received.size() == 10000);
+    for (int i = 0; i < 10000; i++) {
+      assert(received[i] == i);
+    }
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    var arg = [0];
+    for (var i = 0; i < 10000; i++) {
+      arg[0] = i;
+      window.log(arg[0]);
+    }
+    window.done();
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that a result that isn't JSON doesn't affect the others.
+// =================================================================
+static void test_invalid_result() {
+  webview::webview w(false, nullptr);
+  int skipped = 0;
+  w.bind(
+      "ok",
+      [&](const std::string &seq, const std::string &, void *) {
+        w.resolve(seq, 0, "1");
+      },
+      nullptr);
+  w.bind(
+      "bad",
+      [&](const std::string &seq, const std::string &, void *) {
+        w.resolve(seq, 0, "not json");
+      },
+      nullptr);
+  w.bind("skipped", [&]() { ++skipped; });
+  w.bind("done", [&](std::string statuses) {
+    assert(statuses == "fulfilled,rejected,fulfilled");
+    // Envelopes without a sequence number can't be settled
+    assert(skipped == 0);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    window.external.invoke(JSON.stringify({method: 'skipped', params: []}));
+    Promise.allSettled([window.ok(), window.bad(), window.ok()])
+        .then(r => window.done(r.map(s => s.status).join()));
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that calls that are posted in pieces arrive whole.
+// =================================================================
+static void test_call_in_pieces() {
+  webview::webview w(false, nullptr);
+  std::vector<int> received;
+  w.bind("log", [&](int n) { received.push_back(n); });
+  w.bind("upload", [&](std::string data, int n) {
+    received.push_back(n);
+    return data.size();
+  });
+  w.bind("done", [&](size_t size) {
+    // Each emoji is 4 bytes of UTF-8, the pieces must not split them
+    assert(size == 3 * 1024 * 1024 * 2);
+    assert((received == std::vector<int>{1, 2, 3}));
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    window.log(1);
+    var upload = window.upload('\u{1f600}'.repeat(3 * 1024 * 1024 / 2), 2);
+    window.log(3);
+    upload.then(size => window.done(size));
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that many bindings work before and after the page loads.
+// =================================================================
+static void test_bind_many() {
+  webview::webview w(false, nullptr);
+  int sum = 0;
+  for (int i = 0; i < 300; i++) {
+    w.bind("f" + std::to_string(i), [&, i]() { sum += i; });
+  }
+  w.bind("loaded", [&]() {
+    w.bind("done", [&]() {
+      assert(sum == 299 * 300 / 2);
+      w.terminate();
+    });
+  });
+  w.set_html(R"(<script>
+    var calls = [];
+    for (var i = 0; i < 300; i++) {
+      calls.push(window['f' + i]());
+    }
+    Promise.all(calls).then(() => window.loaded()).then(() => window.done());
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that bindings removed before a page loads don't exist on it.
+// =================================================================
+static void test_rebind_before_load() {
+  webview::webview w(false, nullptr);
+  for (int i = 0; i < 100; i++) {
+    w.bind("removed", [](int) {});
+    w.unbind("removed");
+  }
+  w.bind("report", [&](bool removed_exists, bool kept_exists) {
+    assert(!removed_exists);
+    assert(kept_exists);
+    w.terminate();
+  });
+  w.bind("kept", []() {});
+  w.set_html(R"(<script>
+    window.report('removed' in window, typeof window.kept === 'function');
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that calls to a removed binding don't reach the binding
+// that reuses its id.
+// =================================================================
+static void test_reused_binding_id() {
+  webview::webview w(false, nullptr);
+  int calls = 0;
+  w.bind("removed", []() {});
+  w.bind("swap", [&]() {
+    w.unbind("removed");
+    w.bind("added", [&]() { calls++; });
+  });
+  w.bind("done", [&]() {
+    assert(calls == 1);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    var removed = window.removed;
+    window.swap().then(() => {
+      removed();
+      return window.added();
+    }).then(() => window.done());
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that the thread pool runs and steals tasks.
+// =================================================================
+static void test_thread_pool() {
+  std::atomic<int> count{0};
+  {
+    webview::detail::thread_pool pool(4);
+    assert(pool.size() == 4);
+    for (int i = 0; i < 100; i++) {
+      pool.submit([&] {
+        for (int j = 0; j < 100; j++) {
+          pool.submit([&] { ++count; });
+        }
+        ++count;
+      });
+    }
+    while (count < 100 * 101) {
+      std::this_thread::yield();
+    }
+  }
+  assert(count == 100 * 101);
+
+  // Tasks that are still queued run before the pool is destroyed
+  count = 0;
+  {
+    webview::detail::thread_pool pool(1);
+    for (int i = 0; i < 10; i++) {
+      pool.submit([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ++count;
+      });
+    }
+  }
+  assert(count == 10);
+
+  // A task queued by a busy worker has to be stolen by the other one
+  webview::detail::thread_pool pool(2);
+  std::atomic<bool> ran{false};
+  std::atomic<bool> stolen{false};
+  pool.submit([&] {
+    auto self = std::this_thread::get_id();
+    pool.submit([&, self] {
+      stolen = std::this_thread::get_id() != self;
+      ran = true;
+    });
+    while (!ran) {
+      std::this_thread::yield();
+    }
+  });
+  while (!ran) {
+    std::this_thread::yield();
+  }
+  assert(stolen);
+}
+
+// =================================================================
+// TEST: ensure that polled calls are queued in order and bounded.
+// =================================================================
+static void test_call_ring() {
+  webview::detail::call_ring ring(2);
+  std::vector<std::string> calls;
+  auto collect = [&](std::string_view method, std::string_view seq,
+                     std::string_view params) {
+    calls.push_back(std::string(method) + ":" + std::string(seq) + ":" +
+                    std::string(params));
+  };
+  assert(ring.poll(8, collect) == 0);
+  assert(ring.push("a", "1", "[1]"));
+  assert(ring.push("b", "2", "[]"));
+  assert(!ring.push("c", "3", "[]"));
+  // Calls that were handed out keep their slots until the next poll
+  assert(!ring.set_capacity(4));
+  assert(ring.poll(1, collect) == 1);
+  assert(!ring.push("c", "3", "[]"));
+  assert(ring.poll(8, collect) == 1);
+  assert(ring.push("c", "3", "[]"));
+  assert(ring.poll(8, collect) == 1);
+  assert(ring.poll(8, collect) == 0);
+  assert((calls == std::vector<std::string>{"a:1:[1]", "b:2:[]", "c:3:[]"}));
+  assert(ring.set_capacity(3));
+  assert(ring.push("d", "4", "[]"));
+  assert(ring.push("e", "5", "[]"));
+  assert(ring.push("f", "6", "[]"));
+  assert(!ring.push("g", "7", "[]"));
+}
+
+// =================================================================
+// TEST: ensure that messages are handled in arenas that are reused.
+// =================================================================
+static void test_message_arena() {
+#ifdef WEBVIEW_HAVE_PMR
+  using webview::detail::arena_pool;
+  using webview::detail::message_arena;
+  arena_pool pool;
+  assert(message_arena::current() == nullptr);
+  std::pmr::memory_resource *first;
+  {
+    arena_pool::lease arena(pool);
+    first = arena.resource();
+    assert(message_arena::current()->resource() == first);
+    webview::json::tape t(arena.resource());
+    webview::json::params_view params(arena.resource());
+    assert(t.parse(R"([1,"a\nb",[2,3]])"));
+    params.reset(t, 0);
+    webview::detail::arena_string buffer(webview::detail::arena_allocator());
+    assert(buffer.get_allocator().resource() == first);
+    assert(params.str(1, buffer) == "a\nb");
+    webview::json::basic_writer<webview::detail::arena_string> w(
+        buffer.get_allocator());
+    w.begin_array().value(params.text(0)).end_array();
+    assert(w.str() == R"(["1"])");
+    {
+      // Nested messages get an arena of their own
+      arena_pool::lease nested(pool);
+      assert(nested.resource() != first);
+    }
+    assert(message_arena::current()->resource() == first);
+  }
+  assert(message_arena::current() == nullptr);
+  // The arena is reset and handed out again
+  arena_pool::lease again(pool);
+  assert(again.resource() == first);
+#endif
+
+  webview::webview w(false, nullptr);
+  w.use_message_arenas(true);
+  w.bind("join", [](std::string_view a, const std::vector<std::string> &b) {
+    std::string result(a);
+    for (const auto &s : b) {
+      result += s;
+    }
+    return result;
+  });
+  w.bind("pooled", [](std::string_view a) { return std::string(a) + "!"; },
+         webview::binding_thread::pool);
+  w.bind("done", [&](bool ok) {
+    assert(ok);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    Promise.all([window.join('a\n', ['b"', 'c']), window.pooled('d\t')])
+        .then(r => window.done(r[0] === 'a\nb"c' && r[1] === 'd\t!'));
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that pooled bindings run off the main thread.
+// =================================================================
+static void test_pooled_bind() {
+  webview::webview w(false, nullptr);
+  w.set_thread_pool_size(2);
+  auto main_thread = std::this_thread::get_id();
+  w.bind(
+      "square",
+      [&](int n) {
+        assert(std::this_thread::get_id() != main_thread);
+        return n * n;
+      },
+      webview::binding_thread::pool);
+  w.bind(
+      "fail",
+      [](const std::string &) -> std::string {
+        throw std::runtime_error("failed");
+      },
+      webview::binding_thread::pool);
+  w.bind("fail_here", [](const std::string &) -> std::string {
+    throw std::runtime_error("failed here");
+  });
+  w.bind("done", [&](int sum, std::string error, std::string error_here) {
+    assert(std::this_thread::get_id() == main_thread);
+    assert(sum == 99 * 100 * 199 / 6);
+    assert(error == "failed");
+    assert(error_here == "failed here");
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    var calls = [];
+    for (var i = 0; i < 100; i++) {
+      calls.push(window.square(i));
+    }
+    Promise.all(calls).then(squares => window.fail().catch(error =>
+        window.fail_here().catch(errorHere =>
+            window.done(squares.reduce((a, b) => a + b), error, errorHere))));
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that calls can time out and be aborted.
+// =================================================================
+static void test_call_cancellation() {
+  webview::webview w(false, nullptr);
+  std::vector<webview::cancel_token> tokens;
+  w.bind(
+      "never",
+      [&](const std::string &seq, const std::string &, void *) {
+        tokens.push_back(w.get_cancel_token(seq));
+      },
+      nullptr);
+  w.set_binding_timeout("never", 50);
+  std::string forgotten;
+  w.bind(
+      "forget",
+      [&](const std::string &seq, const std::string &, void *) {
+        forgotten = seq;
+      },
+      nullptr);
+  w.bind("done", [&](std::string timeout, std::string abort) {
+    assert(timeout == "TimeoutError");
+    assert(abort == "AbortError");
+    assert(tokens.size() == 2);
+    assert(tokens[0].cancelled());
+    assert(tokens[1].cancelled());
+    // Calls that aren't in progress have no token of their own
+    assert(w.get_cancel_token("unknown").cancelled());
+    // Calls are forgotten if their binding returns without asking for it
+    assert(!forgotten.empty() && w.get_cancel_token(forgotten).cancelled());
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    var controller = new AbortController();
+    window.forget();
+    var timedOut = window.never().catch(e => e.name);
+    var aborted = window.never.with({timeout: 0, signal: controller.signal})()
+        .catch(e => e.name);
+    controller.abort();
+    Promise.all([timedOut, aborted]).then(names => window.done(...names));
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that streaming bindings deliver chunks in order.
+// =================================================================
+static void test_stream_bind() {
+  webview::webview w(false, nullptr);
+  w.bind_stream(
+      "rows",
+      [&](const std::string &seq, const std::string &, void *) {
+        std::thread([&, seq] {
+          for (int i = 0; i < 1000; i++) {
+            w.send_chunk(seq, std::to_string(i));
+          }
+          w.resolve(seq, 0, "");
+        }).detach();
+      },
+      nullptr);
+  w.bind_stream(
+      "failing",
+      [&](const std::string &seq, const std::string &, void *) {
+        w.send_chunk(seq, "\"first\"");
+        w.resolve(seq, 1, "\"failed\"");
+      },
+      nullptr);
+  w.bind("done", [&](bool ordered, std::string first, std::string error) {
+    assert(ordered);
+    assert(first == "first");
+    assert(error == "failed");
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    (async () => {
+      var rows = [];
+      for await (const row of window.rows()) {
+        rows.push(row);
+      }
+      var ordered = rows.length === 1000 && rows.every((n, i) => n === i);
+      var chunks = [];
+      try {
+        for await (const chunk of window.failing()) {
+          chunks.push(chunk);
+        }
+      } catch (error) {
+        window.done(ordered, chunks[0], error);
+      }
+    })();
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that emitted events reach listeners in order.
+// =================================================================
+static void test_emit() {
+  webview::webview w(false, nullptr);
+  w.bind("ready", [&]() {
+    std::thread([&] {
+      for (int i = 0; i < 1000; i++) {
+        w.emit("status", "{\"n\":" + std::to_string(i) + "}");
+      }
+      w.emit("finished", "null");
+    }).detach();
+  });
+  w.bind("done", [&](bool ordered) {
+    assert(ordered);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    var received = [];
+    window.__webview__.addEventListener('status',
+                                        e => received.push(e.detail.n));
+    window.__webview__.addEventListener('finished', () =>
+        window.done(received.length === 1000 &&
+                    received.every((n, i) => n === i)));
+    window.ready();
+  </script>)");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that a bounded dispatch queue applies its policies.
+// =================================================================
+static void test_dispatch_queue() {
+  webview::webview w(false, nullptr);
+  w.set_dispatch_capacity(4);
+  std::vector<int> ran;
+  for (int i = 0; i < 4; i++) {
+    assert(w.dispatch([&, i] { ran.push_back(i); },
+                      webview::dispatch_policy::try_push));
+  }
+  assert(w.dispatch_queue_depth() == 4);
+  assert(!w.dispatch([&] { ran.push_back(-1); },
+                     webview::dispatch_policy::try_push));
+  assert(w.dispatch([&] { ran.push_back(4); },
+                    webview::dispatch_policy::drop_oldest));
+  assert(w.dispatch_queue_depth() == 4);
+  // The main thread doesn't wait for room
+  assert(w.dispatch([&] { ran.push_back(5); }));
+  assert(w.dispatch_queue_depth() == 5);
+  std::thread producer([&] {
+    for (int i = 6; i < 100; i++) {
+      w.dispatch([&, i] { ran.push_back(i); });
+    }
+    w.dispatch([&] { w.terminate(); });
+  });
+  w.run();
+  producer.join();
+  assert(ran.size() == 99);
+  for (size_t i = 0; i < ran.size(); i++) {
+    assert(ran[i] == static_cast<int>(i) + 1);
+  }
+}
+
+// =================================================================
+// TEST: ensure that batches of scripts go through the dispatch queue.
+// =================================================================
+static void test_eval_batch_queue() {
+  webview::webview w(false, nullptr);
+  w.set_dispatch_capacity(1);
+  bool dropped_ran = false;
+  w.bind(
+      "ready",
+      [&](const std::string &, const std::string &, void *) {
+        // The queue is full once this is queued
+        assert(w.dispatch([&] { dropped_ran = true; },
+                          webview::dispatch_policy::try_push));
+        std::string_view scripts[] = {"window.done(1)"};
+        assert(!w.eval_batch(scripts, 1, webview::dispatch_policy::try_push));
+        assert(w.dispatch_queue_depth() == 1);
+        scripts[0] = "window.done(2)";
+        assert(
+            w.eval_batch(scripts, 1, webview::dispatch_policy::drop_oldest));
+        assert(w.dispatch_queue_depth() == 1);
+      },
+      nullptr);
+  w.bind(
+      "done",
+      [&](const std::string &, const std::string &req, void *) {
+        assert(req == "[2]" && !dropped_ran);
+        w.terminate();
+      },
+      nullptr);
+  w.set_html("<script>window.ready()</script>");
+  w.run();
+}
+
+// =================================================================
+// TEST: ensure that a flood of results is limited by the dispatch capacity.
+// =================================================================
+static void test_resolve_flood() {
+  webview::webview w(false, nullptr);
+  w.set_dispatch_capacity(8);
+  std::thread producer;
+  w.bind(
+      "flood",
+      [&](const std::string &seq, const std::string &, void *) {
+        producer = std::thread([&w, seq] {
+          for (int i = 0; i < 1000; i++) {
+            w.emit("tick", std::to_string(i));
+            assert(w.dispatch_queue_depth() <= 8);
+          }
+          w.resolve(seq, 0, "null");
+        });
+      },
+      nullptr);
+  w.bind("done", [&](bool ok) {
+    assert(ok);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    var ticks = [];
+    window.__webview__.addEventListener('tick', e => ticks.push(e.detail));
+    window.flood().then(() => window.done(
+        ticks.length === 1000 && ticks.every((n, i) => n === i)));
+  </script>)");
+  w.run();
+  producer.join();
+}
+
+// =================================================================
+// TEST: ensure that bindings can take slices of the message.
+// =================================================================
+static void test_view_bind() {
+  webview::webview w(false, nullptr);
+  w.bind(
+      "echo",
+      [&](std::string_view seq, std::string_view req, void *) {
+        assert(req == R"(["a\"b",1])");
+        w.resolve(seq, 0, req);
+      },
+      nullptr);
+  w.bind("done", [&](std::string first, int second) {
+    assert(first == "a\"b");
+    assert(second == 1);
+    w.terminate();
+  });
+  w.set_html(R"(<script>
+    window.echo('a"b', 1).then(args => window.done(...args));
+  </script>)");
+  w.run();
+}
+
 // =================================================================
 // TEST: webview_version().
 // =================================================================
@@ -254,6 +1075,569 @@ static void test_json() {
   assert(J("bad", "foo", -1).empty());
 }
 
+// =================================================================
+// TEST: ensure that the JSON tape tokenizes messages in a single pass.
+// =================================================================
+static void test_json_tape() {
+  webview::json::tape t;
+  // Valid input with expected tokens
+  assert(t.parse(R"({"id":1,"method":"foo","params":["bar",2,{"a":[true]}]})"));
+  assert(t.size() == 13);
+  assert(t[0].type == webview::json::token_type::object);
+  assert(t[0].children == 6);
+  assert(t.str(t.find(0, "id")) == "1");
+  assert(t.str(t.find(0, "method")) == "foo");
+  auto params = t.find(0, "params");
+  assert(t.text(params) == R"(["bar",2,{"a":[true]}])");
+  assert(t[params].children == 3);
+  assert(t.text(t.at(params, 2)) == R"({"a":[true]})");
+  assert(t.at(params, 3) == webview::json::tape::npos);
+  assert(t.find(0, "foo") == webview::json::tape::npos);
+  assert(t.parse(R"(["フー", "\"バー\"", -1.5e3, null, false, [], {}])"));
+  assert(t.str(t.at(0, 1)) == R"("バー")");
+  assert(t.text(t.at(0, 2)) == "-1.5e3");
+  assert(t.parse(" 42 "));
+  assert(t.parse(R"("\u00e6")"));
+  // Random access view of the params
+  assert(t.parse(R"({"params":["foo", 1, "bar"]})"));
+  webview::json::params_view p(t, t.find(0, "params"));
+  assert(p.size() == 3);
+  assert(p.str(0) == "foo");
+  assert(p.text(1) == "1");
+  assert(p.str(2) == "bar");
+  assert(p.type(2) == webview::json::token_type::string);
+  assert(p.str(3).empty());
+  p.reset(t, 0);
+  assert(p.empty());
+  // Invalid input - should fail
+  assert(!t.parse(""));
+  assert(!t.parse(R"({"foo":"bar")"));
+  assert(!t.parse(R"({"foo":})"));
+  assert(!t.parse(R"({"foo" "bar"})"));
+  assert(!t.parse(R"({"foo":"bar",})"));
+  assert(!t.parse(R"(["foo",])"));
+  assert(!t.parse(R"(["foo"}])"));
+  assert(!t.parse(R"({}})"));
+  assert(!t.parse(R"({1:2})"));
+  assert(!t.parse(R"("foo)"));
+  assert(!t.parse(R"("\x")"));
+  assert(!t.parse(R"("\u12")"));
+  assert(!t.parse("\"\x80\""));
+  assert(!t.parse("\"\x01\""));
+  assert(!t.parse("bad"));
+  assert(!t.parse("01"));
+  assert(!t.parse("1."));
+  assert(!t.parse("1 2"));
+}
+
+// =================================================================
+// TEST: ensure that the vectorized scanners agree with the scalar ones.
+// =================================================================
+static void test_json_simd() {
+  namespace simd = webview::json::simd;
+  using kernel_t = size_t (*)(const char *, size_t);
+  std::vector<std::pair<kernel_t, kernel_t>> kernels{
+      {simd::scan_string_scalar, simd::scan_literal_scalar}};
+#ifdef WEBVIEW_JSON_SIMD_X86
+  kernels.emplace_back(simd::scan_string_sse2, simd::scan_literal_sse2);
+  if (simd::cpu_supports_avx2()) {
+    kernels.emplace_back(simd::scan_string_avx2, simd::scan_literal_avx2);
+  }
+#endif
+  std::string ascii(100, 'a');
+  std::string utf8;
+  for (int i = 0; i < 20; i++) {
+    utf8 += "フー😀æ";
+  }
+  for (const auto &k : kernels) {
+    auto scan_string = [&](const std::string &s) {
+      return k.first(s.data(), s.size());
+    };
+    auto scan_literal = [&](const std::string &s) {
+      return k.second(s.data(), s.size());
+    };
+    // Plain ASCII is skipped up to the first special character
+    assert(scan_string(ascii) == 100);
+    assert(scan_string(ascii + "\"") == 100);
+    assert(scan_string(ascii + "\\n") == 100);
+    assert(scan_string(ascii + "\n") == 100);
+    assert(scan_string(ascii + "\x7f") == 100);
+    assert(scan_literal(ascii + ",") == 100);
+    assert(scan_literal(ascii + " ") == 100);
+    assert(scan_literal(ascii + "]") == 100);
+    assert(scan_literal("12345678901234567890123456789012345:") == 35);
+    // Multi-byte sequences are never split
+    auto is_boundary = [](const std::string &s, size_t n) {
+      return n == s.size() || (static_cast<unsigned char>(s[n]) & 0xc0) != 0x80;
+    };
+    auto n = scan_string(utf8 + "\"");
+    assert(n <= utf8.size() && is_boundary(utf8, n));
+    n = scan_string(ascii + utf8 + "\xe3\x81\"");
+    assert(n >= 100 && n <= 100 + utf8.size());
+    assert(is_boundary(ascii + utf8, n));
+    n = scan_string(ascii + "\xc3" + ascii);
+    assert(n <= 100);
+    n = scan_string(ascii + "\x80" + ascii);
+    assert(n <= 100);
+  }
+  // Results must be the same as those of the byte-wise state machine
+  auto J = webview::json::json_parse;
+  assert(J("[\"" + ascii + "\", 1]", "", 0) == ascii);
+  assert(J("[\"" + utf8 + "\", 1]", "", 0) == utf8);
+  assert(J("{\"a\":\"" + ascii + utf8 + "\",\"b\":2}", "b", -1) == "2");
+  assert(J("[\"" + ascii + "\xe3\x81\"]", "", 0).empty());
+  assert(J("[\"" + utf8 + "\x80" + ascii + "\"]", "", 0).empty());
+  assert(J("[\"" + ascii + "\x01" + ascii + "\"]", "", 0).empty());
+  assert(J("[" + ascii + "]", "", 0).empty());
+}
+
+// =================================================================
+// TEST: ensure that JSON escaping works.
+// =================================================================
+static void test_json_escape() {
+  auto E = [](const std::string &s) { return webview::json::json_escape(s); };
+  assert(E("") == R"("")");
+  assert(E("foo") == R"("foo")");
+  assert(E(R"("foo")") == R"("\"foo\"")");
+  assert(E(R"(C:\foo)") == R"("C:\\foo")");
+  assert(E("\b\f\n\r\t") == R"("\b\f\n\r\t")");
+  assert(E(std::string("\x00\x01\x1f", 3)) == R"("\u0000\u0001\u001f")");
+  assert(E("/\x7f") == "\"/\x7f\"");
+  assert(E("フー😀") == R"("フー😀")");
+  assert(E("\xe2\x80\xa8\xe2\x80\xa9\xe2\x80\xa6") == R"("\u2028\u2029…")");
+  // Long runs are copied in bulk around the characters that need escaping
+  std::string long_text(100, 'a');
+  assert(E(long_text + "\n" + long_text) ==
+         '"' + long_text + "\\n" + long_text + '"');
+  // Escaped strings must survive a round trip
+  auto J = webview::json::json_parse;
+  auto text = long_text + R"("\/)" + "\n\tフー";
+  assert(J("[" + E(text) + "]", "", 0) == text);
+  // Appending to an existing buffer
+  std::string out = "[";
+  webview::json::json_escape("foo", out);
+  out += ',';
+  webview::json::json_escape(std::string_view("bar\"baz", 3), out);
+  out += ']';
+  assert(out == R"(["foo","bar"])");
+}
+
+// =================================================================
+// TEST: ensure that JSON unescaping works.
+// =================================================================
+static void test_json_unescape() {
+  auto U = [](const std::string &s) {
+    std::string buffer;
+    std::string_view value;
+    if (webview::json::json_unescape(s, buffer, value) < 0) {
+      return std::string("<invalid>");
+    }
+    return std::string(value);
+  };
+  assert(U(R"("")").empty());
+  assert(U(R"("foo")") == "foo");
+  assert(U(R"("\"\\\/\b\f\n\r\t")") == "\"\\/\b\f\n\r\t");
+  // Unicode escapes are decoded to UTF-8
+  assert(U(R"("\u0041\u00e6\u30d5\u30fc")") == "Aæフー");
+  assert(U(R"("\u0000")") == std::string(1, '\0'));
+  assert(U(R"("\uD83D\uDE00")") == "😀");
+  assert(U(R"("\ud83d\ude00!")") == "😀!");
+  // Lone surrogates are replaced
+  assert(U(R"("\ud83d")") == "\xef\xbf\xbd");
+  assert(U(R"("\ude00x")") == "\xef\xbf\xbdx");
+  assert(U(R"("\ud83d\u0041")") == "\xef\xbf\xbd" "A");
+  // Invalid input
+  assert(U(R"(foo)") == "<invalid>");
+  assert(U(R"("foo)") == "<invalid>");
+  assert(U(R"("\x")") == "<invalid>");
+  assert(U(R"("\u12")") == "<invalid>");
+  assert(U(R"("\u12G4")") == "<invalid>");
+  assert(U(R"("\")") == "<invalid>");
+  // Values without escapes are returned as views into the source
+  std::string buffer;
+  std::string_view value;
+  std::string source = R"("foo")";
+  assert(webview::json::json_unescape(source, buffer, value) == 3);
+  assert(value.data() == source.data() + 1);
+  source = R"("f\u00f6o")";
+  assert(webview::json::json_unescape(source, buffer, value) == 4);
+  assert(value == "föo" && value.data() == buffer.data());
+  // The C-style interface computes sizes and decodes in place
+  source = R"("\u30d5\n")";
+  assert(webview::json::json_unescape(source.c_str(), source.size(),
+                                      nullptr) == 4);
+  // json_parse() and the tape decode escapes as well
+  assert(webview::json::json_parse(R"(["\u30d5\u30fc"])", "", 0) == "フー");
+  webview::json::tape t;
+  assert(t.parse(R"(["foo", "b\u00e6r", 1])"));
+  webview::json::params_view p(t, 0);
+  assert(p.str(0, buffer) == "foo");
+  assert(p.str(1, buffer) == "bær");
+  assert(p.str(2, buffer) == "1");
+}
+
+// =================================================================
+// TEST: ensure that messages can be read in chunks.
+// =================================================================
+static void test_json_incremental() {
+  std::string big(1000, 'x');
+  std::string msg = R"({"id":1,"method":"foo","params":["bär",[1,2],)"
+                    R"({"a":"]"},")" +
+                    big + "\\n\\u00e6\\ud83d\\ude00\"]}";
+  std::string members;
+  std::vector<std::string> params;
+  webview::json::incremental_reader r;
+  r.on_member = [&](std::string_view key, std::string_view value) {
+    members += std::string(key) + "=" + std::string(value) + ";";
+  };
+  r.on_param = [&](size_t index, std::string_view value) {
+    assert(index == params.size());
+    params.emplace_back(value);
+  };
+  auto check = [&] {
+    assert(r.done());
+    assert(members == R"(id=1;method="foo";)");
+    assert(params.size() == 4);
+    assert(params[0] == R"("bär")");
+    assert(params[1] == "[1,2]");
+    assert(params[2] == R"({"a":"]"})");
+    assert(params[3] == "\"" + big + "\\n\\u00e6\\ud83d\\ude00\"");
+  };
+  // Split the message in two at every byte, including inside of escape
+  // sequences and UTF-8 sequences
+  for (size_t split = 0; split <= msg.size(); split++) {
+    members.clear();
+    params.clear();
+    r.reset();
+    assert(r.feed(msg.data(), split));
+    assert(split == msg.size() || !r.done());
+    assert(r.feed(msg.data() + split, msg.size() - split));
+    check();
+  }
+  // Feed the message in chunks of various sizes
+  for (size_t chunk : {1, 3, 7, 64, 4096}) {
+    members.clear();
+    params.clear();
+    r.reset();
+    for (size_t i = 0; i < msg.size(); i += chunk) {
+      assert(!r.done());
+      assert(r.feed(msg.data() + i, std::min(chunk, msg.size() - i)));
+    }
+    check();
+  }
+  // Calls of the runtime are reported as envelopes
+  members.clear();
+  params.clear();
+  r.reset();
+  assert(r.feed(R"([3,42,["a",1]])") && r.done());
+  assert(members == "method=3;id=42;");
+  assert((params == std::vector<std::string>{R"("a")", "1"}));
+  // Large strings can be passed on in decoded pieces instead
+  std::string spilled;
+  int spill_calls = 0;
+  members.clear();
+  params.clear();
+  r.reset();
+  r.spill_threshold = 100;
+  r.on_spill = [&](size_t index, std::string_view chunk, bool last) {
+    assert(index == 3);
+    // Pieces are passed on once the threshold has been reached
+    assert(last || chunk.size() >= 100);
+    spilled += chunk;
+    spill_calls++;
+    if (last) {
+      params.emplace_back("<spilled>");
+    }
+  };
+  for (size_t i = 0; i < msg.size(); i += 10) {
+    assert(r.feed(msg.data() + i, std::min<size_t>(10, msg.size() - i)));
+  }
+  assert(r.done());
+  assert(params.size() == 4);
+  // Short strings are escaped again
+  assert(params[0] == R"("bär")");
+  assert(params[3] == "<spilled>");
+  assert(spilled == big + "\næ\xf0\x9f\x98\x80");
+  assert(spill_calls > 1);
+  // Invalid input - should fail
+  for (std::string bad : {R"({"a":})", R"({"a" 1})", R"({"a":tru})",
+                          R"({"a":"\x"})", R"({}})", R"({"params":[1}})"}) {
+    params.clear();
+    r.reset();
+    assert(!r.feed(bad) || !r.done());
+  }
+  // Strings are validated like by the tape
+  webview::json::tape t;
+  for (std::string s : {"\"\x7f\"", "\"\x01\"", "\"\xf4\x8f\xbf\xbf\"",
+                        "\"\xf5\x80\x80\x80\"", "\"\xc3\"", "\"\x80\""}) {
+    r.reset();
+    auto accepted = r.feed("[") && r.feed(s) && r.feed("]") && r.done();
+    assert(accepted == t.parse("[" + s + "]"));
+  }
+  r.reset();
+  assert(r.feed("{\"a\":") && r.feed("1}") && r.done());
+}
+
+// =================================================================
+// TEST: ensure that numbers and arrays of numbers decode without copies.
+// =================================================================
+static void test_json_numbers() {
+  namespace simd = webview::json::simd;
+  using kernel_t = size_t (*)(const char *, size_t);
+  std::vector<kernel_t> kernels{simd::scan_digits_scalar};
+#ifdef WEBVIEW_JSON_SIMD_X86
+  kernels.push_back(simd::scan_digits_sse2);
+  if (simd::cpu_supports_avx2()) {
+    kernels.push_back(simd::scan_digits_avx2);
+  }
+#endif
+  std::string digits;
+  for (int i = 0; i < 70; i++) {
+    digits += static_cast<char>('0' + i % 10);
+  }
+  for (auto scan_digits : kernels) {
+    for (size_t n = 0; n <= digits.size(); n++) {
+      for (const char *stop : {"", ".", "e", "/", ":", "\xb0"}) {
+        auto s = digits.substr(0, n) + stop + "123";
+        assert(scan_digits(s.data(), s.size()) == (*stop ? n : n + 3));
+      }
+    }
+  }
+  assert(simd::parse_eight_digits("12345678") == 12345678);
+  assert(simd::parse_eight_digits("09000001") == 9000001);
+
+  using webview::json::json_parse_number;
+  int64_t i = 0;
+  assert(json_parse_number("0", i) && i == 0);
+  assert(json_parse_number("-0", i) && i == 0);
+  assert(json_parse_number("123456789012", i) && i == 123456789012);
+  assert(json_parse_number("9223372036854775807", i) && i == INT64_MAX);
+  assert(json_parse_number("-9223372036854775808", i) && i == INT64_MIN);
+  assert(!json_parse_number("9223372036854775808", i));
+  assert(!json_parse_number("99999999999999999999", i));
+  for (const char *bad :
+       {"", "-", "01", "1.5", "1e3", "+1", "1 ", "0x1", "a"}) {
+    assert(!json_parse_number(bad, i));
+  }
+  double d = 0;
+  assert(json_parse_number("42", d) && d == 42);
+  assert(json_parse_number("-0", d) && d == 0 && std::signbit(d));
+  assert(json_parse_number("0.1", d) && d == 0.1);
+  assert(json_parse_number("-1.5e3", d) && d == -1500);
+  assert(json_parse_number("2E-2", d) && d == 0.02);
+  assert(json_parse_number("12345678901234567890", d) &&
+         d == 12345678901234567890.0);
+  assert(json_parse_number("1.7976931348623157e308", d) &&
+         d == 1.7976931348623157e308);
+  assert(!json_parse_number("1e400", d));
+  for (const char *bad : {"", ".5", "1.", "1e", "01", "inf", "nan", "- 1"}) {
+    assert(!json_parse_number(bad, d));
+  }
+
+  webview::json::tape t;
+  std::string json = "[[1, -2.5, 3e2], [], [7, 8, 9], [1, \"2\"], [[1]], 4]";
+  assert(t.parse(json));
+  webview::json::params_view params(t, 0);
+  std::vector<double> doubles{99};
+  assert(params.numbers(0, doubles));
+  assert((doubles == std::vector<double>{1, -2.5, 300}));
+  assert(params.numbers(1, doubles) && doubles.empty());
+  std::vector<int64_t> ints;
+  assert(!params.numbers(0, ints));
+  assert(params.numbers(2, ints));
+  assert((ints == std::vector<int64_t>{7, 8, 9}));
+  int64_t span[3];
+  assert(params.numbers(2, span, 3) == 3 && span[2] == 9);
+  assert(params.numbers(2, span, 2) == webview::json::tape::npos);
+  assert(params.numbers(3, doubles) == false);
+  assert(params.numbers(4, doubles) == false);
+  assert(params.numbers(5, doubles) == false);
+  assert(params.numbers(6, doubles) == false);
+  assert(params.number(5, i) && i == 4);
+  assert(!params.number(3, i));
+
+  // A large array decodes in one go
+  json = "[";
+  for (int n = 0; n < 100000; n++) {
+    json += (n ? "," : "") + std::to_string(n) + ".25";
+  }
+  json += "]";
+  assert(t.parse(json));
+  assert(t.numbers(0, doubles) && doubles.size() == 100000);
+  assert(doubles[0] == 0.25 && doubles[99999] == 99999.25);
+}
+
+// =================================================================
+// TEST: ensure that only calls in the stub's layout are sliced.
+// =================================================================
+static void test_json_slice_call() {
+  std::string_view id, seq, params;
+  auto slice = [&](std::string_view msg) {
+    return webview::json::json_slice_call(msg, id, seq, params);
+  };
+  assert(slice(R"([12,345,["a",1,{"b":[]}]])"));
+  assert(id == "12" && seq == "345" && params == R"(["a",1,{"b":[]}])");
+  assert(slice("[0,1,[]]"));
+  assert(id == "0" && seq == "1" && params == "[]");
+  for (const char *other : {
+           R"({"id":1,"method":"foo","params":[]})",
+           R"([[0,1,[]],[0,2,[]]])",
+           R"(["0",1,[]])",
+           "[0, 1,[]]",
+           "[0,1,[]] ",
+           "[0,1,{}]",
+           "[0,1]",
+           "[0,,[]]",
+           "[0,1,[]",
+           "[0,12345678901234567890,[]]",
+           "",
+       }) {
+    assert(!slice(other));
+  }
+
+  // Batches are split at the brackets that are outside of strings
+  std::vector<std::string_view> calls;
+  auto split = [&](std::string_view msg) {
+    calls.clear();
+    return webview::json::json_slice_batch(
+        msg, [&](std::string_view call) { calls.push_back(call); });
+  };
+  assert(split(R"([[0,1,["]\"",{"[":"}"}]],[-1,2],[1,3,[[],"é"]]])"));
+  assert(calls.size() == 3);
+  assert(calls[0] == R"([0,1,["]\"",{"[":"}"}]])");
+  assert(calls[1] == "[-1,2]");
+  assert(calls[2] == R"([1,3,[[],"é"]])");
+  // Calls that can't be delimited are dropped along with the rest
+  assert(split(R"([[0,1,[]],[0,2,["]]])") && calls.size() == 1);
+  for (const char *other :
+       {"[0,1,[]]", R"([{"id":1}])", "[[0,1,[\"]]]", "[[]", "[[0]] "}) {
+    assert(!split(other) && calls.empty());
+  }
+}
+
+// =================================================================
+// TEST: ensure that values convert between JSON and C++ types.
+// =================================================================
+template <typename T>
+static bool decode_value(const std::string &json, T &out) {
+  webview::json::tape t;
+  std::string buffer;
+  assert(t.parse(json));
+  return webview::json::value_traits<T>::decode(t, 0, out, buffer);
+}
+
+template <typename T> static std::string encode_value(const T &value) {
+  webview::json::writer w;
+  webview::json::value_traits<T>::encode(w, value);
+  return w.take();
+}
+
+static void test_json_value_traits() {
+  bool b = false;
+  assert(decode_value("true", b) && b);
+  assert(!decode_value("1", b));
+  int i = 0;
+  assert(decode_value("-42", i) && i == -42);
+  assert(!decode_value("2147483648", i));
+  assert(!decode_value("1.5", i));
+  assert(!decode_value("\"1\"", i));
+  unsigned char u = 0;
+  assert(decode_value("255", u) && u == 255);
+  assert(!decode_value("-1", u));
+  float f = 0;
+  assert(decode_value("0.5", f) && f == 0.5f);
+  std::string s;
+  assert(decode_value(R"("a\"b")", s) && s == "a\"b");
+  assert(!decode_value("null", s));
+  std::optional<std::string> o;
+  assert(decode_value("null", o) && !o);
+  assert(decode_value(R"("x")", o) && o == "x");
+  std::vector<int> v;
+  assert(decode_value("[1, 2, 3]", v) && (v == std::vector<int>{1, 2, 3}));
+  assert(!decode_value("[1, \"2\"]", v));
+  std::vector<double> d;
+  assert(decode_value("[1, 2.5]", d) && (d == std::vector<double>{1, 2.5}));
+  std::vector<bool> vb;
+  assert(decode_value("[true, false]", vb) && vb[0] && !vb[1]);
+  std::map<std::string, std::vector<std::string>> m;
+  assert(decode_value(R"({"a": ["b"], "c": []})", m) && m.size() == 2 &&
+         m["a"][0] == "b" && m["c"].empty());
+  // Values that are missing altogether
+  webview::json::tape t;
+  std::string buffer;
+  assert(t.parse("[]"));
+  assert(!webview::json::value_traits<int>::decode(t, t.at(0, 0), i, buffer));
+  std::optional<int> oi = 1;
+  assert(webview::json::value_traits<std::optional<int>>::decode(
+             t, t.at(0, 0), oi, buffer) &&
+         !oi);
+
+  assert(encode_value(std::vector<int>{1, 2}) == "[1,2]");
+  assert(encode_value(std::map<std::string, double>{{"a", 0.5}}) ==
+         R"({"a":0.5})");
+  assert(encode_value(std::optional<bool>{}) == "null");
+  assert(encode_value(std::string("\n")) == R"("\n")");
+  char c;
+  assert(decode_value(R"("x")", c) && c == 'x');
+  assert(!decode_value("120", c) && !decode_value(R"("xy")", c));
+  assert(encode_value('"') == R"("\"")");
+}
+
+// =================================================================
+// TEST: ensure that JSON can be written without concatenation.
+// =================================================================
+static void test_json_writer() {
+  webview::json::writer w;
+  w.begin_object()
+      .key("str")
+      .value("a\"b")
+      .key("int")
+      .value(-42)
+      .key("uint")
+      .value(18446744073709551615ull)
+      .key("double")
+      .value(0.5)
+      .key("nan")
+      .value(std::nan(""))
+      .key("bools")
+      .begin_array()
+      .value(true)
+      .value(false)
+      .end_array()
+      .key("null")
+      .value(nullptr)
+      .key("empty")
+      .begin_object()
+      .end_object()
+      .key("raw")
+      .raw("[1,2]")
+      .end_object();
+  assert(w.str() == R"({"str":"a\"b","int":-42,"uint":18446744073709551615,)"
+                    R"("double":0.5,"nan":null,"bools":[true,false],)"
+                    R"("null":null,"empty":{},"raw":[1,2]})");
+  // The output must be valid JSON
+  webview::json::tape t;
+  assert(t.parse(w.str()));
+  assert(t.str(t.find(0, "str")) == "a\"b");
+  // Taking the result leaves the writer ready for the next one
+  auto taken = w.take();
+  assert(w.str().empty());
+  w.begin_array().value(1).value(std::string("2")).end_array();
+  assert(w.str() == R"([1,"2"])");
+  // Writing into a caller-supplied buffer
+  std::string buffer;
+  webview::json::writer bw(buffer);
+  bw.value(1.25);
+  assert(buffer == "1.25");
+  bw.clear();
+  bw.begin_array().end_array();
+  assert(buffer == "[]");
+  // Characters are strings while other small integers are numbers
+  bw.clear();
+  bw.begin_array().value('a').value(static_cast<signed char>(1)).end_array();
+  assert(buffer == R"(["a",1])");
+}
+
 static void run_with_timeout(std::function<void()> fn, int timeout_ms) {
   std::atomic_flag flag_running = ATOMIC_FLAG_INIT;
   flag_running.test_and_set();
@@ -352,8 +1736,39 @@ int main(int argc, char *argv[]) {
   std::unordered_map<std::string, std::function<void()>> all_tests = {
       {"terminate", test_terminate},     {"c_api", test_c_api},
       {"c_api_bind", test_c_api_bind},   {"c_api_version", test_c_api_version},
+      {"c_api_sized_strings", test_c_api_sized_strings},
+      {"c_api_batch", test_c_api_batch},
+      {"c_api_poll_messages", test_c_api_poll_messages},
       {"bidir_comms", test_bidir_comms}, {"json", test_json},
-      {"sync_bind", test_sync_bind}};
+      {"sync_bind", test_sync_bind},     {"json_tape", test_json_tape},
+      {"params_bind", test_params_bind}, {"json_simd", test_json_simd},
+      {"json_escape", test_json_escape},
+      {"json_unescape", test_json_unescape},
+      {"json_incremental", test_json_incremental},
+      {"json_writer", test_json_writer},
+      {"json_numbers", test_json_numbers},
+      {"json_slice_call", test_json_slice_call},
+      {"trusted_envelopes", test_trusted_envelopes},
+      {"json_value_traits", test_json_value_traits},
+      {"typed_bind", test_typed_bind},
+      {"resolve_burst", test_resolve_burst},
+      {"batched_calls", test_batched_calls},
+      {"invalid_result", test_invalid_result},
+      {"call_in_pieces", test_call_in_pieces},
+      {"bind_many", test_bind_many},
+      {"rebind_before_load", test_rebind_before_load},
+      {"reused_binding_id", test_reused_binding_id},
+      {"thread_pool", test_thread_pool},
+      {"call_ring", test_call_ring},
+      {"pooled_bind", test_pooled_bind},
+      {"call_cancellation", test_call_cancellation},
+      {"stream_bind", test_stream_bind},
+      {"emit", test_emit},
+      {"dispatch_queue", test_dispatch_queue},
+      {"eval_batch_queue", test_eval_batch_queue},
+      {"resolve_flood", test_resolve_flood},
+      {"view_bind", test_view_bind},
+      {"message_arena", test_message_arena}};
 #if _WIN32
   all_tests.emplace("parse_version", test_parse_version);
   all_tests.emplace("win32_narrow_wide_string_conversion",